@@ -0,0 +1,236 @@
+#include "Benchmark.h"
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstring>
+#include <cstdio>
+#include <memory>
+#include <chrono>
+#include <sstream>
+#include <SDL.h>
+#include "Chip8.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#elif defined(__APPLE__)
+#include <mach/mach.h>
+#else
+#include <unistd.h>
+#endif
+
+double Timings::average() const {
+	if (m_samples.empty())
+		return 0;
+
+	double total = 0;
+	for (double ms : m_samples)
+		total += ms;
+	return total / m_samples.size();
+}
+
+double Timings::percentile(double p) const {
+	if (m_samples.empty())
+		return 0;
+
+	std::vector<double> sorted(m_samples);
+	std::sort(sorted.begin(), sorted.end());
+	size_t i = (size_t)(p * (sorted.size() - 1) + 0.5);
+	return sorted[std::min(i, sorted.size() - 1)];
+}
+
+double Timings::worst() const {
+	return m_samples.empty() ? 0 : *std::max_element(m_samples.begin(), m_samples.end());
+}
+
+void Timings::print(std::ostream& out, const char* name) const {
+	std::ios::fmtflags flags = out.flags();
+	out << std::fixed << std::setprecision(4)
+		<< name << ": " << count() << " runs, average " << average() << " ms, median " << percentile(0.5)
+		<< " ms, 99th percentile " << percentile(0.99) << " ms, worst " << worst() << " ms\n";
+	out.flags(flags);
+}
+
+size_t residentBytes() {
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return 0;
+	return counters.WorkingSetSize;
+#elif defined(__APPLE__)
+	mach_task_basic_info info;
+	mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+	if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) != KERN_SUCCESS)
+		return 0;
+	return info.resident_size;
+#else
+	// Second field of statm is the resident set, in pages
+	FILE* f = fopen("/proc/self/statm", "r");
+	if (f == NULL)
+		return 0;
+	unsigned long size = 0, resident = 0;
+	int read = fscanf(f, "%lu %lu", &size, &resident);
+	fclose(f);
+	return read == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+
+bool drawSpriteReference(uint8_t pixels[CH8_HEIGHT][CH8_WIDTH], const uint8_t* sprite, uint8_t vx, uint8_t vy, int rows, bool wrap) {
+	bool collision = false;
+	for (int row = 0; row < rows; row++) {
+		for (int col = 0; col < CH8_MAX_SPRITE_WIDTH; col++) {
+			if (!(sprite[row] & (0x80 >> col)))
+				continue;
+
+			int pX = (uint8_t)(vx + col);
+			int pY = (uint8_t)(vy + row);
+			if (pX >= CH8_WIDTH) {
+				if (!wrap)
+					continue;
+				pX %= CH8_WIDTH;
+			}
+			if (pY >= CH8_HEIGHT) {
+				if (!wrap)
+					continue;
+				pY %= CH8_HEIGHT;
+			}
+
+			if (pixels[pY][pX])
+				collision = true;
+			pixels[pY][pX] ^= 1;
+		}
+	}
+	return collision;
+}
+
+// The loop both sides run: I = sprite, then DXYN, V0 += 3, V1 += 5 and back to the DXYN
+// The baseline has V2 += 1 where the DXYN was, so taking its time away leaves the sprite alone
+static std::vector<char> spriteLoop(bool draw) {
+	const uint8_t code[] = {
+		0xA2, 0x10,                        // 200: I = 210
+		draw ? (uint8_t)0xD0 : (uint8_t)0x72, draw ? (uint8_t)0x1F : (uint8_t)0x01,
+		0x70, 0x03,                        // 204: V0 += 3
+		0x71, 0x05,                        // 206: V1 += 5
+		0x12, 0x02                         // 208: jump to 202
+	};
+	std::vector<char> rom(0x10 + BENCH_SPRITE_ROWS, 0);
+	memcpy(rom.data(), code, sizeof(code));
+	for (int i = 0; i < BENCH_SPRITE_ROWS; i++)
+		rom[0x10 + i] = (char)(0xA5 ^ (i * 0x1D));
+	return rom;
+}
+
+// Run iterations times round a spriteLoop on chip, returning ms
+static double runSpriteLoop(Chip8& chip, const std::vector<char>& rom, long iterations) {
+	chip.init();
+	chip.loadProgram(rom);
+	chip.emulateCycle();
+
+	const uint64_t start = SDL_GetPerformanceCounter();
+	for (long i = 0; i < iterations; i++)
+		for (int c = 0; c < 4; c++)
+			chip.emulateCycle();
+	return (SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+int benchSprites(long iterations) {
+	if (iterations < 1)
+		iterations = 1;
+
+	const std::vector<char> drawing = spriteLoop(true);
+	const std::vector<char> baseline = spriteLoop(false);
+	const uint8_t* sprite = (const uint8_t*)&drawing[0x10];
+
+	// Too big for the stack with the reference screen next to it
+	std::unique_ptr<Chip8> chip(new Chip8());
+	static uint8_t pixels[CH8_HEIGHT][CH8_WIDTH];
+
+	Timings packed, loop, reference;
+	bool collision = false;
+	for (int round = 0; round < BENCH_SPRITE_ROUNDS; round++) {
+		loop.add(runSpriteLoop(*chip, baseline, iterations));
+		packed.add(runSpriteLoop(*chip, drawing, iterations));
+
+		// Same positions the loop goes through, with the register adds done in C
+		memset(pixels, 0, sizeof(pixels));
+		uint8_t vx = 0, vy = 0;
+		const uint64_t start = SDL_GetPerformanceCounter();
+		for (long i = 0; i < iterations; i++) {
+			collision = drawSpriteReference(pixels, sprite, vx, vy, BENCH_SPRITE_ROWS, chip->wrapIsEnabled());
+			vx += 3;
+			vy += 5;
+		}
+		reference.add((SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+	}
+
+	// The last packed run is still on chip, so both screens should be the same
+	long wrong = 0;
+	for (int y = 0; y < CH8_HEIGHT; y++)
+		for (int x = 0; x < CH8_WIDTH; x++)
+			if (chip->getPixel(x, y) != pixels[y][x])
+				++wrong;
+	if (wrong != 0 || (chip->getV()[0xF] != 0) != collision) {
+		std::cerr << "DXYN and the reference disagree: " << wrong << " pixels differ, VF " << (int)chip->getV()[0xF]
+			<< " against " << collision << std::endl;
+		return ERR_BENCH_MISMATCH;
+	}
+
+	// Medians per sprite, in ns
+	const double perSprite = 1e6 / iterations;
+	const double loopNs = loop.percentile(0.5) * perSprite;
+	const double packedNs = packed.percentile(0.5) * perSprite - loopNs;
+	const double referenceNs = reference.percentile(0.5) * perSprite;
+
+	std::ios::fmtflags flags = std::cout.flags();
+	std::cout << std::fixed << std::setprecision(1)
+		<< "DXYN, 8x15 sprites, " << iterations << " per round, median of " << BENCH_SPRITE_ROUNDS << " rounds\n"
+		<< "  packed rows (Chip8):     " << packedNs << " ns per sprite, after " << loopNs << " ns of loop around it\n"
+		<< "  byte per pixel (scalar): " << referenceNs << " ns per sprite\n"
+		<< "  " << std::setprecision(2) << referenceNs / packedNs << "x faster, same screen and VF\n";
+	std::cout.flags(flags);
+	return SUCCESS;
+}
+
+int benchStartup(const std::string& self, const std::string& rom, int runs) {
+	Timings startup;
+	for (int i = 0; i < runs; i++) {
+		// The child works out its own time from this, since steady_clock is the same for every process
+		const long long launch = std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+		std::ostringstream command;
+		command << '"' << self << "\" --startup-probe " << launch << " \"" << rom << '"';
+
+#ifdef _WIN32
+		// cmd takes the outer pair of quotes off the line, so the whole line gets one more
+		FILE* child = _popen(("\"" + command.str() + "\"").c_str(), "r");
+#else
+		FILE* child = popen(command.str().c_str(), "r");
+#endif
+		if (child == NULL) {
+			std::cerr << "Could not start " << self << std::endl;
+			return ERR_BENCH_LAUNCH;
+		}
+
+		double ms = -1;
+		char line[256];
+		while (fgets(line, sizeof(line), child) != NULL)
+			sscanf(line, "First frame presented %lf", &ms);
+#ifdef _WIN32
+		_pclose(child);
+#else
+		pclose(child);
+#endif
+
+		if (ms < 0) {
+			std::cerr << "Run " << i + 1 << " never presented a frame" << std::endl;
+			return ERR_BENCH_LAUNCH;
+		}
+		startup.add(ms);
+		std::cout << "Run " << i + 1 << ": " << ms << " ms\n";
+	}
+
+	startup.print(std::cout, "Launch to first present");
+	return SUCCESS;
+}
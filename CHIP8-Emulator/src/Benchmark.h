@@ -0,0 +1,53 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "constants.h"
+
+// Collects how long each run of something took and prints the spread
+// The benchmark modes in main use it so their numbers read the same way
+class Timings {
+public:
+	// Make room for n runs up front, so adding them doesn't allocate in the middle of a measurement
+	// The room is written once too, so the pages are in memory before anything measures it
+	void reserve(size_t n) { m_samples.assign(n, 0.0); m_samples.clear(); }
+
+	// Add one run, in ms
+	void add(double ms) { m_samples.push_back(ms); }
+
+	size_t count() const { return m_samples.size(); }
+	double average() const;
+
+	// The run at fraction p of the way from fastest to slowest, 0.5 for the median
+	double percentile(double p) const;
+	double worst() const;
+
+	// One line: name, runs, average, median, 99th percentile and worst, in ms
+	void print(std::ostream& out, const char* name) const;
+
+private:
+	std::vector<double> m_samples;
+};
+
+// How much of the process is in memory, in bytes; 0 where that can't be asked
+size_t residentBytes();
+
+// DXYN the way Chip8 drew it before its display was packed into words: a byte per pixel, one pixel
+// at a time, wrapping or clipping each one; returns whether a lit pixel was turned off
+// Kept as the scalar reference benchSprites checks the packed drawing against and times it next to
+bool drawSpriteReference(uint8_t pixels[CH8_HEIGHT][CH8_WIDTH], const uint8_t* sprite, uint8_t vx, uint8_t vy, int rows, bool wrap);
+
+// Draw iterations 8x15 sprites at moving positions with Chip8's DXYN and with drawSpriteReference,
+// BENCH_SPRITE_ROUNDS times over, and print the time per sprite for each
+// Fails with ERR_BENCH_MISMATCH if the two don't end with the same screen and VF
+int benchSprites(long iterations);
+
+// Start self with --startup-probe on rom runs times, each a fresh process, and print how long each
+// took from launch to its first present; fails with ERR_BENCH_LAUNCH if one never presents
+int benchStartup(const std::string& self, const std::string& rom, int runs);
+
+#endif
@@ -0,0 +1,202 @@
+#include "CallbackAudio.h"
+#include <iostream>
+#include <cstring>
+#include <algorithm>
+
+CallbackAudio::CallbackAudio() {
+	m_device = 0;
+	m_freq = SOUND_FREQUENCY;
+	m_bufferSamples = SOUND_NUM_SAMPLES;
+	m_targetMs = 0;
+	m_gain = SOUND_DEFAULT_GAIN;
+	m_counterFrequency = 1;
+	m_delay = 0;
+	memset(&m_requested, 0, sizeof(m_requested));
+	m_pending = false;
+	memset(&m_playing, 0, sizeof(m_playing));
+	m_beepPhase = 0;
+	m_patternPos = 0;
+	m_lastCallback = 0;
+	m_underruns = 0;
+	m_lateEvents = 0;
+	m_latencyTotal = 0;
+	m_latencyCount = 0;
+	m_latencyWorst = 0;
+}
+
+CallbackAudio::~CallbackAudio() {
+	close();
+}
+
+bool CallbackAudio::open(double latencyMs, int gain) {
+	close();
+
+	// The biggest power of two that fits in the latency, since that's what devices take
+	int samples = SOUND_MIN_DEVICE_SAMPLES;
+	while (samples * 2 <= SOUND_NUM_SAMPLES && samples * 2 <= latencyMs * SOUND_FREQUENCY / 1000.0)
+		samples *= 2;
+
+	SDL_AudioSpec want, have;
+	SDL_zero(want);
+	want.freq = SOUND_FREQUENCY;
+	want.samples = (Uint16)samples;
+	want.channels = SOUND_NUM_CHANNELS;
+	want.format = AUDIO_S16SYS;
+	want.callback = callback;
+	want.userdata = this;
+
+	// Everything the callback touches is set before the device can call it
+	m_freq = SOUND_FREQUENCY;
+	m_gain = (int16_t)gain;
+	m_counterFrequency = (double)SDL_GetPerformanceFrequency();
+	memset(&m_requested, 0, sizeof(m_requested));
+	m_pending = false;
+	memset(&m_playing, 0, sizeof(m_playing));
+	m_beepPhase = 0;
+	m_patternPos = 0;
+	m_lastCallback = 0;
+	m_underruns = 0;
+	m_lateEvents = 0;
+	m_latencyTotal = 0;
+	m_latencyCount = 0;
+	m_latencyWorst = 0;
+
+	// Format and rate are converted by SDL if the device differs, the buffer size is whatever it gives
+	m_device = SDL_OpenAudioDevice(NULL, 0, &want, &have, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+	if (m_device == 0) {
+		std::cerr << "Could not open the audio device. SDL Error: " << SDL_GetError() << std::endl;
+		return false;
+	}
+
+	m_bufferSamples = have.samples;
+	const double bufferMs = m_bufferSamples * 1000.0 / m_freq;
+	m_targetMs = std::max(latencyMs, bufferMs);
+	m_delay = (m_targetMs - bufferMs) / 1000.0;
+
+	SDL_PauseAudioDevice(m_device, 0);
+	return true;
+}
+
+void CallbackAudio::close() {
+	if (m_device == 0)
+		return;
+
+	// Waits for a callback that's running to return
+	SDL_CloseAudioDevice(m_device);
+	m_device = 0;
+
+	while (m_events.peek() != NULL)
+		m_events.pop();
+}
+
+bool CallbackAudio::sameState(const Event& a, const Event& b) {
+	if (a.on != b.on || a.hasPattern != b.hasPattern)
+		return false;
+	if (!a.hasPattern)
+		return true;
+	return a.rate == b.rate && memcmp(a.pattern, b.pattern, sizeof(a.pattern)) == 0;
+}
+
+void CallbackAudio::setGate(bool on, const uint8_t* pattern, double rate) {
+	if (m_device == 0)
+		return;
+
+	Event e;
+	e.on = on;
+	e.hasPattern = pattern != NULL;
+	if (e.hasPattern)
+		memcpy(e.pattern, pattern, sizeof(e.pattern));
+	else memset(e.pattern, 0, sizeof(e.pattern));
+	e.rate = e.hasPattern ? rate : 0;
+
+	// A pattern or pitch change while the tone is off isn't heard, so it waits for the tone to start
+	if (!sameState(e, m_requested) && (on || m_requested.on)) {
+		e.time = SDL_GetPerformanceCounter();
+		m_requested = e;
+		m_pending = true;
+	}
+
+	if (m_pending && m_events.push(m_requested))
+		m_pending = false;
+}
+
+void SDLCALL CallbackAudio::callback(void* userdata, Uint8* stream, int len) {
+	static_cast<CallbackAudio*>(userdata)->render((int16_t*)stream, len / (int)sizeof(int16_t));
+}
+
+void CallbackAudio::render(int16_t* out, int n) {
+	const uint64_t now = SDL_GetPerformanceCounter();
+
+	// The device asks for the next buffer as the last one starts playing, so a longer gap than a
+	// buffer lasts means it played silence in between
+	if (m_lastCallback != 0 && (now - m_lastCallback) / m_counterFrequency > 1.5 * n / m_freq)
+		++m_underruns;
+	m_lastCallback = now;
+
+	const double bufferSeconds = (double)n / m_freq;
+	int done = 0;
+	while (done < n) {
+		const Event* e = m_events.peek();
+
+		// Sample 0 of this buffer is heard one buffer from now, so an event is due m_delay after its stamp
+		int at = n;
+		if (e != NULL) {
+			double due = ((double)(int64_t)(e->time - now) / m_counterFrequency + m_delay) * m_freq;
+			if (due < n)
+				at = std::max(done, (int)due);
+			if (due < 0)
+				++m_lateEvents;
+		}
+
+		synthesize(out, done, at);
+		done = at;
+		if (at == n)
+			break;
+
+		// Stamp to first sample out of the device: the wait until now, its place in this buffer, and the buffer
+		double latency = ((double)(int64_t)(now - e->time) / m_counterFrequency + (double)at / m_freq + bufferSeconds) * 1000.0;
+		m_latencyTotal = m_latencyTotal + latency;
+		++m_latencyCount;
+		if (latency > m_latencyWorst)
+			m_latencyWorst = latency;
+
+		// A tone starting from silence starts at the top of its wave, like a fresh queue would
+		if (e->on && !m_playing.on) {
+			m_beepPhase = 0;
+			m_patternPos = 0;
+		}
+		m_playing = *e;
+		m_events.pop();
+	}
+}
+
+void CallbackAudio::synthesize(int16_t* out, int from, int to) {
+	if (!m_playing.on) {
+		std::fill(out + from, out + to, 0);
+		return;
+	}
+
+	if (m_playing.hasPattern) {
+		// XO-CHIP: step through the 128-bit pattern at the rate set by the pitch register
+		const double step = m_playing.rate / m_freq;
+		for (int i = from; i < to; i++) {
+			int bit = (int)m_patternPos;
+			bool on = (m_playing.pattern[bit >> 3] >> (7 - (bit & 7))) & 1;
+			out[i] = on ? m_gain : -m_gain;
+
+			m_patternPos += step;
+			if (m_patternPos >= XO_AUDIO_PATTERN_SIZE * 8)
+				m_patternPos -= XO_AUDIO_PATTERN_SIZE * 8;
+		}
+		return;
+	}
+
+	// Square wave, low half first like the queued beep
+	const double step = (double)SOUND_DEFAULT_PLAY_FREQUENCY / m_freq;
+	for (int i = from; i < to; i++) {
+		out[i] = m_beepPhase < 0.5 ? -m_gain : m_gain;
+		m_beepPhase += step;
+		if (m_beepPhase >= 1.0)
+			m_beepPhase -= 1.0;
+	}
+}
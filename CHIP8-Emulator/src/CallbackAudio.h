@@ -0,0 +1,98 @@
+#ifndef CALLBACKAUDIO_H
+#define CALLBACKAUDIO_H
+
+#include <cstdint>
+#include <atomic>
+#include <SDL.h>
+#include "SpscRing.h"
+#include "constants.h"
+
+// Plays the tone from SDL's audio callback instead of a queue that can run minutes ahead of the game
+// The thread that owns chip only says when the tone starts, stops or changes pattern; those events go
+// over a lock-free ring stamped with when they happened, and the callback makes the samples itself,
+// starting each change a fixed latency after its stamp, to the sample
+// The latency is the device buffer plus however long events are held back on top of it, so the
+// shortest it can be is one device buffer
+class CallbackAudio {
+public:
+	CallbackAudio();
+
+	// Closes the device
+	~CallbackAudio();
+
+	// Open the default output device with a buffer no longer than latencyMs and start it playing silence
+	bool open(double latencyMs, int gain);
+	void close();
+
+	bool isOpen() const { return m_device != 0; }
+	SDL_AudioDeviceID getDevice() const { return m_device; }
+
+	// From whichever thread owns chip, after every frame: whether the tone is on, and the XO-CHIP
+	// pattern (NULL for the plain beep) and its rate in bits per second
+	// Only a change is sent; one that finds the ring full is kept and tried again next time
+	void setGate(bool on, const uint8_t* pattern, double rate);
+
+	// Device buffer in samples and the latency aimed for, in ms
+	int getBufferSamples() const { return m_bufferSamples; }
+	double getTargetLatency() const { return m_targetMs; }
+
+	// Callbacks that came later than the previous buffer could last, so the device ran dry
+	unsigned long getUnderruns() const { return m_underruns; }
+
+	// Events that reached the callback too late to start on time, and were started straight away
+	unsigned long getLateEvents() const { return m_lateEvents; }
+
+	// From an event's stamp to its first sample leaving the device buffer, in ms, over every event so far
+	double getLatencyAverage() const { return m_latencyCount ? m_latencyTotal / m_latencyCount : 0.0; }
+	double getLatencyWorst() const { return m_latencyWorst; }
+
+private:
+	// A change in what the tone is doing
+	struct Event {
+		uint64_t time;
+		bool on;
+		bool hasPattern;
+		uint8_t pattern[XO_AUDIO_PATTERN_SIZE];
+		double rate;
+	};
+
+	SDL_AudioDeviceID m_device;
+	int m_freq;
+	int m_bufferSamples;
+	double m_targetMs;
+	int16_t m_gain;
+
+	// Counter ticks per second, and how long events wait on top of the device buffer
+	double m_counterFrequency;
+	double m_delay;
+
+	SpscRing<Event, SOUND_EVENT_QUEUE_SIZE> m_events;
+
+	// Only used by setGate: the state last asked for, and one that didn't fit in the ring yet
+	Event m_requested;
+	bool m_pending;
+
+	// Only used in the callback: the state being played and where the waves are
+	Event m_playing;
+	double m_beepPhase;
+	double m_patternPos;
+	uint64_t m_lastCallback;
+
+	std::atomic<unsigned long> m_underruns;
+	std::atomic<unsigned long> m_lateEvents;
+	std::atomic<double> m_latencyTotal;
+	std::atomic<unsigned long> m_latencyCount;
+	std::atomic<double> m_latencyWorst;
+
+	static void SDLCALL callback(void* userdata, Uint8* stream, int len);
+
+	// Fill out with n samples, starting whatever events fall inside them
+	void render(int16_t* out, int n);
+
+	// Make samples [from, to) of out with the state being played
+	void synthesize(int16_t* out, int from, int to);
+
+	static bool sameState(const Event& a, const Event& b);
+};
+
+#endif
@@ -1,12 +1,20 @@
 #include "Chip8.h"
 #include <iostream>
 #include <fstream>
+#include <cstring>
+#include <cmath>
+#include <vector>
 #include <SDL.h>
 #include "constants.h"
 
 void unknownOpcode(uint16_t opcode);
 
 Chip8::Chip8() {
+	for (int i = 0; i < SCHIP_NUM_FLAGS; i++)
+		rplFlags[i] = 0;
+	snapshotSeq[0].store(0);
+	snapshotSeq[1].store(0);
+	latestSnapshot.store(0);
 	init();
 }
 
@@ -21,7 +29,11 @@ void Chip8::init() {
 	// Reset stack pointer
 	sp = 0;
 
-	// Clear display
+	// Start in CHIP-8 low-res mode and clear display
+	hiRes = false;
+	halted = false;
+	megaMode = false;
+	planeMask = 0x1;
 	clearDisp();
 
 	// Clear registers
@@ -32,9 +44,9 @@ void Chip8::init() {
 	for (int i = 0; i < CH8_STACK_SIZE; i++)
 		stack[i] = 0;
 
-	// Clear memory
-	for (int i = pc; i < CH8_MEM_SIZE; i++)
-		memory[i] = 0;
+	// Clear memory, dropping any extra a MegaChip ROM asked for
+	memory.assign(CH8_MEM_SIZE, 0);
+	addrMask = CH8_MEM_SIZE - 1;
 
 	// Reset delay timer
 	dTimer = 0;
@@ -60,8 +72,23 @@ void Chip8::init() {
 	for (int i = 0; i < 80; i++)
 		memory[i] = CH8_FONTSET[i];
 
+	// Load in SUPER-CHIP large digits right after it
+	for (int i = 0; i < 100; i++)
+		memory[SCHIP_BIG_FONT_OFFSET + i] = SCHIP_BIG_FONTSET[i];
+
 	soundTimerIsUpdated = false;
 
+	// No XO-CHIP audio pattern until F002 loads one
+	for (int i = 0; i < XO_AUDIO_PATTERN_SIZE; i++)
+		audioPattern[i] = 0;
+	pitch = XO_DEFAULT_PITCH;
+	audioPatternSet = false;
+	updatePatternRate();
+
+	// Readers should see the reset machine right away
+	cycleCount = 0;
+	snapshotCount = 0;
+	publishState();
 }
 
 void Chip8::emulateCycle() {
@@ -69,22 +96,61 @@ void Chip8::emulateCycle() {
 	// Reset drawing flag
 	drawFlag = false;
 
+	// 00FD stops the interpreter for good
+	if (halted)
+		return;
+
+	++cycleCount;
+
 	// Get opcode
-	uint16_t opcode = (memory[pc] << 8) | memory[pc + 1];
+	uint16_t opcode = (memory[pc] << 8) | memory[(pc + 1) & addrMask];
 
 	// Get lower 4 bits of high byte of the instruction
 	uint8_t x = memory[pc] & 0x0F;
 
 	// Get upper 4 bits of low byte of instruction
-	uint8_t y = (memory[pc + 1] & 0xF0) >> 4;
+	uint8_t y = (memory[(pc + 1) & addrMask] & 0xF0) >> 4;
 
 	// Decode opcode
 	switch (opcode & 0xF000) {
 	case 0x000:
+		if ((opcode & 0x0F00) != 0) {
+			megaOpcode(opcode);
+			break;
+		}
+
+		if ((opcode & 0x00F0) == 0x00B0 && megaMode) {
+			// 00BN: Scroll the display up N pixels (MegaChip)
+			mega->scrollUp(opcode & 0x000F);
+			incrPC();
+			break;
+		}
+
+		if ((opcode & 0x00F0) == 0x00C0) {
+			// 00CN: Scroll the display down N pixels (SUPER-CHIP)
+			scrollDown(opcode & 0x000F);
+			drawFlag = true;
+			incrPC();
+			break;
+		}
+
+		if ((opcode & 0x00F0) == 0x00D0) {
+			// 00DN: Scroll the display up N pixels (XO-CHIP)
+			scrollUp(opcode & 0x000F);
+			drawFlag = true;
+			incrPC();
+			break;
+		}
+
 		switch (opcode & 0x00FF) {
 		case 0x00E0:
-			// 00E0: Clears the screen
-			clearDisp();
+			// 00E0: Clears the screen (only the selected planes on XO-CHIP)
+			// MegaChip draws off screen, so this is also where its frame gets shown
+			if (megaMode) {
+				mega->present();
+				dirtyRows = ~0ULL;
+			}
+			else clearPlanes();
 			drawFlag = true;
 			incrPC();
 			break;
@@ -95,6 +161,60 @@ void Chip8::emulateCycle() {
 			incrPC();
 			break;
 
+		case 0x0010:
+			// 0010: Turn MegaChip mode off
+			megaMode = false;
+			clearDisp();
+			drawFlag = true;
+			incrPC();
+			break;
+
+		case 0x0011:
+			// 0011: Turn MegaChip mode on, 256x192 with 8-bit color
+			if (!mega)
+				mega.reset(new MegaDisplay());
+			mega->reset();
+			megaMode = true;
+			dirtyRows = ~0ULL;
+			drawFlag = true;
+			incrPC();
+			break;
+
+		case 0x00FB:
+			// 00FB: Scroll the display right 4 pixels (SUPER-CHIP)
+			scrollRight(SCHIP_SCROLL_X);
+			drawFlag = true;
+			incrPC();
+			break;
+
+		case 0x00FC:
+			// 00FC: Scroll the display left 4 pixels (SUPER-CHIP)
+			scrollLeft(SCHIP_SCROLL_X);
+			drawFlag = true;
+			incrPC();
+			break;
+
+		case 0x00FD:
+			// 00FD: Exit the interpreter (SUPER-CHIP)
+			halted = true;
+			break;
+
+		case 0x00FE:
+			// 00FE: Switch to 64x32 low-res mode (SUPER-CHIP)
+			hiRes = false;
+			clearDisp();
+			drawFlag = true;
+			incrPC();
+			break;
+
+		case 0x00FF:
+			// 00FF: Switch to 128x64 high-res mode (SUPER-CHIP)
+			hiRes = true;
+			clearDisp();
+			drawFlag = true;
+			incrPC();
+			break;
+
 		default:
 			std::cerr << "Trying to call RCA 1802 at " << std::hex << (0x0FFF & opcode) << std::dec << " (?)" << std::endl;
 		}
@@ -114,22 +234,53 @@ void Chip8::emulateCycle() {
 	case 0x3000:
 		// 3XNN: Skips the next instruction if VX equals NN
 		if (V[x] == (opcode & 0x00FF))
-			incrPC();
+			skipNext();
 		incrPC();
 		break;
 
 	case 0x4000:
 		// 4XNN: Skips the next instruction if VX doesn't equal NN
 		if (V[x] != (opcode & 0x00FF))
-			incrPC();
+			skipNext();
 		incrPC();
 		break;
 
 	case 0x5000:
-		// 5XY0: Skips the next instruction if VX equals VY
-		if (V[x] == V[y])
+		switch (opcode & 0x000F) {
+		case 0x0000:
+			// 5XY0: Skips the next instruction if VX equals VY
+			if (V[x] == V[y])
+				skipNext();
 			incrPC();
-		incrPC();
+			break;
+
+		case 0x0002: {
+			// 5XY2: Stores VX to VY (in either order) in memory starting at address I, I is left unmodified (XO-CHIP)
+			int step = x <= y ? 1 : -1;
+			for (int i = 0, r = x; ; i++, r += step) {
+				memory[(I + i) & addrMask] = V[r];
+				if (r == y)
+					break;
+			}
+			incrPC();
+			break;
+		}
+
+		case 0x0003: {
+			// 5XY3: Fills VX to VY (in either order) from memory starting at address I, I is left unmodified (XO-CHIP)
+			int step = x <= y ? 1 : -1;
+			for (int i = 0, r = x; ; i++, r += step) {
+				V[r] = memory[(I + i) & addrMask];
+				if (r == y)
+					break;
+			}
+			incrPC();
+			break;
+		}
+
+		default:
+			unknownOpcode(opcode);
+		}
 		break;
 
 	case 0x6000:
@@ -221,7 +372,7 @@ void Chip8::emulateCycle() {
 	case 0x9000:
 		// 9XY0: Skips the next instruction if VX doesn't equal VY
 		if (V[x] != V[y])
-			incrPC();
+			skipNext();
 		incrPC();
 
 	case 0xA000:
@@ -248,58 +399,36 @@ void Chip8::emulateCycle() {
 		// Each row of 8 pixels is read as bit-coded starting from memory location I
 		// I value doesnt change after the execution of this instruction
 		// VF is set to 1 if any screen pixels are flipped from set to unset when the sprite is drawn, and to 0 if that doesnt happen
+		// DXY0: SUPER-CHIP 16x16 sprite, read as two bytes per row
+
+		// XO-CHIP: draws to every selected plane, each plane's sprite data follows the previous one's
+		// MegaChip: draws an indexed-color sprite of the size set by 03NN/04NN
+		if (megaMode) {
+			V[0xF] = drawMegaSprite(V[x], V[y]) ? 1 : 0;
+			incrPC();
+			break;
+		}
 
 		// Get m_height of sprite
 		int spriteHeight = opcode & 0x0F;
-
-		// Reset VF Register since we don't know if there was collision yet
-		V[0xF] = 0;
-
-		// We will store the coordinates of the pixel here
-		uint8_t pX, pY;
-
-		// We will store the current row of the sprite here
-		uint8_t spriteRow;
-
-		// Loop for number of rows the sprite takes up
-		for (int row = 0; row < spriteHeight; row++) {
-
-			// Get one row of sprite at a time
-			spriteRow = memory[I + row];
-
-			// Each sprite is 8 pixels wide
-			for (int col = 0; col < CH8_MAX_SPRITE_WIDTH; col++) {
-				pX = V[x] + col;
-				pY = V[y] + row;
-
-				// Get bit to check if it's set
-				uint8_t bit = spriteRow & (0x80 >> col);
-
-				// Check if bit is set
-				if (bit) {
-
-					// Check whether to wrap around
-					if (pX >= CH8_WIDTH) {
-						if (wrapFlag)
-							pX %= CH8_WIDTH;
-						else continue;
-					}
-					if (pY > CH8_HEIGHT) {
-						if (wrapFlag)
-							pY %= CH8_HEIGHT;
-						else continue;
-					}
-					// Check if bit is already set
-					if (gfx[pX][pY] == 1)
-						V[0xF] = 1;
-
-					// XOR the bit using 1 to flip it
-					gfx[pX][pY] ^= 1;
-				}
-
+		bool wide = spriteHeight == 0;
+		if (wide)
+			spriteHeight = SCHIP_BIG_SPRITE_SIZE;
+
+		int spriteBytes = wide ? spriteHeight * 2 : spriteHeight;
+		uint16_t addr = I;
+		bool collision = false;
+		uint8_t vx = V[x], vy = V[y];
+
+		for (int plane = 0; plane < XO_NUM_PLANES; plane++) {
+			if (planeMask & (1 << plane)) {
+				collision |= drawSprite(plane, addr, vx, vy, spriteHeight, wide);
+				addr += spriteBytes;
 			}
 		}
 
+		V[0xF] = collision ? 1 : 0;
+
 		drawFlag = true;
 		incrPC();
 		break;
@@ -310,14 +439,14 @@ void Chip8::emulateCycle() {
 		case 0x009E:
 			// EX9E: Skips the next instruction if the key stored in VX is pressed
 			if (keys[V[x]])
-				incrPC();
+				skipNext();
 			incrPC();
 			break;
 			
 		case 0x00A1:
 			// EXA1: Skips the next instruction if the key stored in VX isn't pressed
 			if (!keys[V[x]])
-				incrPC();
+				skipNext();
 			incrPC();
 			break;
 
@@ -328,6 +457,26 @@ void Chip8::emulateCycle() {
 
 	case 0xF000:
 		switch (opcode & 0x00FF) {
+		case 0x0000:
+			// F000 NNNN: Sets I to the 16-bit address in the next two bytes (XO-CHIP)
+			I = (memory[(pc + 2) & addrMask] << 8) | memory[(pc + 3) & addrMask];
+			pc += 4;
+			break;
+
+		case 0x0001:
+			// FN01: Selects the planes N that drawing, clearing and scrolling apply to (XO-CHIP)
+			planeMask = x & ((1 << XO_NUM_PLANES) - 1);
+			incrPC();
+			break;
+
+		case 0x0002:
+			// F002: Loads the 16-byte audio pattern from memory starting at address I (XO-CHIP)
+			for (int i = 0; i < XO_AUDIO_PATTERN_SIZE; i++)
+				audioPattern[i] = memory[(I + i) & addrMask];
+			audioPatternSet = true;
+			incrPC();
+			break;
+
 		case 0x0007:
 			// FX07: Sets VX to the value of the delay timer
 			V[x] = dTimer;
@@ -380,25 +529,52 @@ void Chip8::emulateCycle() {
 			incrPC();
 			break;
 
+		case 0x003A:
+			// FX3A: Sets the audio pattern pitch register to VX (XO-CHIP)
+			pitch = V[x];
+			updatePatternRate();
+			incrPC();
+			break;
+
+		case 0x0030:
+			// FX30: Sets I to the 8x10 digit sprite for the value in VX (SUPER-CHIP)
+			I = SCHIP_BIG_FONT_OFFSET + (V[x] % 10) * SCHIP_BIG_FONT_WIDTH;
+			incrPC();
+			break;
+
 		case 0x0033:
 			// FX33: Take the decimal representation of VX, place the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2
-			memory[I] = V[x] / 100;
-			memory[I + 1] = (V[x] % 100 ) / 10;
-			memory[I + 2] = V[x] % 10;
+			memory[I & addrMask] = V[x] / 100;
+			memory[(I + 1) & addrMask] = (V[x] % 100 ) / 10;
+			memory[(I + 2) & addrMask] = V[x] % 10;
 			incrPC();
 			break;
 
 		case 0x0055:
 			// FX55: Stores V0 to VX (including VX) in memory starting at address I. The offset from I is increased by 1 for each value written, but I itself is left unmodified
 			for (int i = 0; i <= x; i++)
-				memory[I + i] = V[i];
+				memory[(I + i) & addrMask] = V[i];
 			incrPC();
 			break;
 
 		case 0x0065:
 			// FX65: Fills V0 to VX (including VX) with values from memory starting at address I. I is left unmodified
 			for (int i = 0; i <= x; i++)
-				V[i] = memory[I + i];
+				V[i] = memory[(I + i) & addrMask];
+			incrPC();
+			break;
+
+		case 0x0075:
+			// FX75: Stores V0 to VX in the RPL user flags, X < 8 (SUPER-CHIP) or any X (XO-CHIP)
+			for (int i = 0; i <= x && i < SCHIP_NUM_FLAGS; i++)
+				rplFlags[i] = V[i];
+			incrPC();
+			break;
+
+		case 0x0085:
+			// FX85: Fills V0 to VX from the RPL user flags, X < 8 (SUPER-CHIP) or any X (XO-CHIP)
+			for (int i = 0; i <= x && i < SCHIP_NUM_FLAGS; i++)
+				V[i] = rplFlags[i];
 			incrPC();
 			break;
 
@@ -419,11 +595,18 @@ void Chip8::setKeys(bool a[]) {
 }
 
 int Chip8::loadRom(std::string name) {
+	std::vector<char> rom;
+	int result = readRom(name, rom);
+	if (result != SUCCESS)
+		return result;
 
-	// First 0x200 bytes reserved for interpretter (font in our case)
-	const int MAX_ROM_SIZE = CH8_MEM_SIZE - 0x200;
+	return loadProgram(rom);
+}
 
-	char tempBuffer[MAX_ROM_SIZE];
+int Chip8::readRom(const std::string& name, std::vector<char>& buffer, bool quiet) {
+
+	// First 0x200 bytes reserved for interpretter (font in our case)
+	const int MAX_ROM_SIZE = MEGA_MEM_SIZE - 0x200;
 
 	// Read ROM file into memory
 	std::ifstream rom(name, std::ios::in | std::ios::binary);
@@ -442,6 +625,9 @@ int Chip8::loadRom(std::string name) {
 		return ERR_ROM_TOO_BIG;
 	}
 
+	// Too big for the stack now that memory is 64 KB
+	buffer.resize(romSize);
+
 	// Reset 
 	rom.seekg(0, rom.beg);
 
@@ -449,21 +635,41 @@ int Chip8::loadRom(std::string name) {
 	rom.clear();
 
 	// Read file into temporary buffer
-	rom.read(tempBuffer, romSize);
+	rom.read(buffer.data(), romSize);
 
 	// Check if ROM was read into temporary buffer successfully
-	if (rom)
-		std::cout << "All " << rom.gcount() << " bytes read successfully.\n";
+	if (rom) {
+		if (!quiet)
+			std::cout << "All " << rom.gcount() << " bytes read successfully.\n";
+	}
 	else {
 		std::cerr << "error: only " << rom.gcount() << "bytes could be read";
 		return ERR_ROM_READ;
 	}
 
 	rom.close();
+	return SUCCESS;
+}
+
+int Chip8::loadProgram(const std::vector<char>& rom) {
+	const size_t romSize = rom.size();
+	if (romSize > (size_t)MEGA_MEM_SIZE - 0x200) {
+		std::cerr << "File too large!";
+		return ERR_ROM_TOO_BIG;
+	}
+
+	// MegaChip ROMs can be bigger than 64 KB, grow memory to the next power of two so addresses still mask
+	size_t needed = CH8_MEM_SIZE;
+	while (needed < 0x200 + romSize)
+		needed <<= 1;
+	if (needed > memory.size()) {
+		memory.resize(needed, 0);
+		addrMask = needed - 1;
+	}
 
 	// Read into memory
-	for (int i = 0; i < romSize; i++)
-		memory[0x200 + i] = tempBuffer[i];
+	for (size_t i = 0; i < romSize; i++)
+		memory[0x200 + i] = rom[i];
 
 	return SUCCESS;
 }
@@ -476,23 +682,323 @@ bool Chip8::isAudioUpdated() {
 	return false;
 }
 
-void Chip8::decrTimers() {
+bool Chip8::decrTimers() {
 	uint32_t currTime = SDL_GetTicks();
 	if (currTime - lastTime > TARGET_FRAMETIME_MILLISECONDS) {
 		lastTime = currTime;
-
-		if (sTimer > 0)
-			--sTimer;
-		if (dTimer > 0)
-			--dTimer;
+		tickTimers();
+		return true;
 	}
 
+	return false;
+}
+
+void Chip8::tickTimers() {
+	if (sTimer > 0)
+		--sTimer;
+	if (dTimer > 0)
+		--dTimer;
+
+	// A timer tick marks the end of a frame
+	publishState();
+}
+
+void Chip8::publishState() {
+	int slot = latestSnapshot.load(std::memory_order_relaxed) ^ 1;
+	uint32_t seq = snapshotSeq[slot].load(std::memory_order_relaxed);
+
+	// Mark the slot as being written before touching it
+	snapshotSeq[slot].store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	Chip8State& state = snapshots[slot];
+	state.pc = pc;
+	state.I = I;
+	memcpy(state.V, V, sizeof(V));
+	state.dTimer = dTimer;
+	state.sTimer = sTimer;
+	state.hiRes = hiRes;
+	state.megaMode = megaMode;
+	memcpy(state.gfx, gfx, sizeof(gfx));
+	state.cycles = cycleCount;
+	state.frame = snapshotCount++;
+
+	snapshotSeq[slot].store(seq + 2, std::memory_order_release);
+	latestSnapshot.store(slot, std::memory_order_release);
+}
+
+bool Chip8::readState(Chip8State& out) const {
+	for (int attempt = 0; attempt < SNAPSHOT_READ_ATTEMPTS; attempt++) {
+		int slot = latestSnapshot.load(std::memory_order_acquire);
+		uint32_t before = snapshotSeq[slot].load(std::memory_order_acquire);
+
+		// Writer lapped us and is refilling this slot
+		if (before & 1)
+			continue;
+
+		memcpy(&out, &snapshots[slot], sizeof(Chip8State));
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (snapshotSeq[slot].load(std::memory_order_relaxed) == before)
+			return true;
+	}
+	return false;
 }
 
 void Chip8::clearDisp() {
-	for (int i = 0; i < CH8_WIDTH; i++)
-		for (int j = 0; j < CH8_HEIGHT; j++)
-			gfx[i][j] = 0;
+	memset(gfx, 0, sizeof(gfx));
+	dirtyRows = ~0ULL;
+}
+
+void Chip8::skipNext() {
+	uint8_t next = memory[(pc + 2) & addrMask];
+
+	// F000 NNNN and MegaChip's 01NN NNNN take up four bytes
+	bool longInstr = (next == 0xF0 && memory[(pc + 3) & addrMask] == 0x00) || (megaMode && next == 0x01);
+	pc += longInstr ? 4 : 2;
+}
+
+void Chip8::megaOpcode(uint16_t opcode) {
+	uint8_t nn = opcode & 0x00FF;
+
+	if (!megaMode) {
+		std::cerr << "Trying to call RCA 1802 at " << std::hex << (0x0FFF & opcode) << std::dec << " (?)" << std::endl;
+		return;
+	}
+
+	switch (opcode & 0x0F00) {
+	case 0x0100:
+		// 01NN NNNN: Sets I to the 24-bit address NN NNNN
+		I = (nn << 16) | (memory[(pc + 2) & addrMask] << 8) | memory[(pc + 3) & addrMask];
+		pc += 4;
+		return;
+
+	case 0x0200: {
+		// 02NN: Loads NN ARGB colors from memory starting at address I into the palette
+		int count = nn;
+		while (count > 0 && (I & addrMask) + count * 4 > memory.size())
+			--count;
+		mega->loadPalette(&memory[I & addrMask], count);
+		break;
+	}
+
+	case 0x0300:
+		// 03NN: Sets the sprite width to NN
+		mega->setSpriteWidth(nn);
+		break;
+
+	case 0x0400:
+		// 04NN: Sets the sprite height to NN
+		mega->setSpriteHeight(nn);
+		break;
+
+	case 0x0500:
+		// 05NN: Sets the screen alpha to NN
+		mega->setAlpha(nn);
+		break;
+
+	case 0x0600:
+	case 0x0700:
+		// 060N/0700: Play/stop digitized sound, not supported so the ROM just runs silent
+		break;
+
+	case 0x0800:
+		// 080N: Sets the blend mode to N
+		mega->setBlendMode(opcode & 0x000F);
+		break;
+
+	case 0x0900:
+		// 09NN: Sets the collision color to index NN
+		mega->setCollisionColor(nn);
+		break;
+
+	default:
+		std::cerr << "Trying to call RCA 1802 at " << std::hex << (0x0FFF & opcode) << std::dec << " (?)" << std::endl;
+		return;
+	}
+
+	incrPC();
+}
+
+bool Chip8::drawMegaSprite(uint8_t vx, uint8_t vy) {
+	int w = mega->getSpriteWidth();
+	int h = mega->getSpriteHeight();
+	uint32_t addr = I & addrMask;
+
+	// Sprite data has to be contiguous, drop rows that would run off the end of memory
+	while (h > 0 && addr + (size_t)w * h > memory.size())
+		--h;
+
+	return mega->drawSprite(&memory[addr], vx, vy, w, h);
+}
+
+void Chip8::clearPlanes() {
+	for (int p = 0; p < XO_NUM_PLANES; p++)
+		if (planeMask & (1 << p))
+			memset(gfx[p], 0, sizeof(gfx[p]));
+	dirtyRows = ~0ULL;
+}
+
+void Chip8::updatePatternRate() {
+	patternRate = XO_AUDIO_BASE_RATE * pow(2.0, (pitch - 64) / 48.0);
+}
+
+// Rotate right that compilers turn into a single instruction, s must be 0-63
+static inline uint64_t rotr64(uint64_t v, int s) {
+	return (v >> s) | (v << ((64 - s) & 63));
+}
+
+bool Chip8::drawSprite(int plane, uint16_t addr, uint8_t vx, uint8_t vy, int rows, bool wide) {
+	const int width = getWidth();
+	const int height = getHeight();
+	const int words = getRowWords();
+
+	// The starting position always wraps, only the parts hanging off the edge obey wrapFlag
+	int x = vx & (width - 1);
+	int y = vy & (height - 1);
+	int word = x >> 6;
+	int shift = x & 63;
+
+	// Rotating a left-aligned sprite row right by shift puts it at column x within its word
+	// Bits that rotate around to the front of the word belong in the next word over
+	uint64_t stayMask = ~0ULL >> shift;
+	int next = word + 1;
+	uint64_t nextMask = ~stayMask;
+	if (next == words) {
+		// Off the right edge: wrap to the first word or drop it
+		next = 0;
+		if (!wrapFlag)
+			nextMask = 0;
+	}
+
+	// In 64-pixel rows both halves land in the same word, so one mask does it
+	if (next == word) {
+		stayMask |= nextMask;
+		nextMask = 0;
+	}
+
+	// Rows below the bottom edge wrap to the top or get dropped
+	if (!wrapFlag && y + rows > height)
+		rows = height - y;
+
+	uint64_t* dest = gfx[plane];
+	uint64_t hit = 0;
+
+	for (int row = 0; row < rows; row++) {
+		int pY = (y + row) & (height - 1);
+		dirtyRows |= 1ULL << pY;
+
+		// Left-align the sprite row in a 64-bit word
+		uint64_t bits;
+		if (wide)
+			bits = (uint64_t)((memory[(addr + row * 2) & addrMask] << 8) | memory[(addr + row * 2 + 1) & addrMask]) << 48;
+		else bits = (uint64_t)memory[(addr + row) & addrMask] << 56;
+
+		uint64_t rot = rotr64(bits, shift);
+		uint64_t* line = dest + pY * words;
+
+		// One XOR per word touched, collisions are any set bit the sprite covers
+		uint64_t m = rot & stayMask;
+		hit |= line[word] & m;
+		line[word] ^= m;
+
+		m = rot & nextMask;
+		hit |= line[next] & m;
+		line[next] ^= m;
+	}
+
+	return hit != 0;
+}
+
+void Chip8::scrollDown(int n) {
+	if (megaMode) {
+		mega->scrollDown(n);
+		return;
+	}
+
+	// Every row moves, so all of them need uploading again
+	dirtyRows = ~0ULL;
+
+	const int height = getHeight();
+	const int words = getRowWords();
+	if (n > height)
+		n = height;
+
+	// Move whole rows down and blank the ones scrolled in at the top
+	for (int p = 0; p < XO_NUM_PLANES; p++) {
+		if (!(planeMask & (1 << p)))
+			continue;
+		memmove(gfx[p] + n * words, gfx[p], (height - n) * words * sizeof(uint64_t));
+		memset(gfx[p], 0, n * words * sizeof(uint64_t));
+	}
+}
+
+void Chip8::scrollUp(int n) {
+	if (megaMode) {
+		mega->scrollUp(n);
+		return;
+	}
+
+	dirtyRows = ~0ULL;
+
+	const int height = getHeight();
+	const int words = getRowWords();
+	if (n > height)
+		n = height;
+
+	for (int p = 0; p < XO_NUM_PLANES; p++) {
+		if (!(planeMask & (1 << p)))
+			continue;
+		memmove(gfx[p], gfx[p] + n * words, (height - n) * words * sizeof(uint64_t));
+		memset(gfx[p] + (height - n) * words, 0, n * words * sizeof(uint64_t));
+	}
+}
+
+void Chip8::scrollRight(int n) {
+	if (megaMode) {
+		mega->scrollRight(n);
+		return;
+	}
+
+	dirtyRows = ~0ULL;
+
+	const int height = getHeight();
+	const int words = getRowWords();
+
+	for (int p = 0; p < XO_NUM_PLANES; p++) {
+		if (!(planeMask & (1 << p)))
+			continue;
+		for (int y = 0; y < height; y++) {
+			// Shift the row as one wide integer, carrying bits from each word into the next
+			uint64_t* row = gfx[p] + y * words;
+			for (int w = words - 1; w > 0; w--)
+				row[w] = (row[w] >> n) | (row[w - 1] << (64 - n));
+			row[0] >>= n;
+		}
+	}
+}
+
+void Chip8::scrollLeft(int n) {
+	if (megaMode) {
+		mega->scrollLeft(n);
+		return;
+	}
+
+	dirtyRows = ~0ULL;
+
+	const int height = getHeight();
+	const int words = getRowWords();
+
+	for (int p = 0; p < XO_NUM_PLANES; p++) {
+		if (!(planeMask & (1 << p)))
+			continue;
+		for (int y = 0; y < height; y++) {
+			uint64_t* row = gfx[p] + y * words;
+			for (int w = 0; w < words - 1; w++)
+				row[w] = (row[w] << n) | (row[w + 1] >> (64 - n));
+			row[words - 1] <<= n;
+		}
+	}
 }
 
 void unknownOpcode(uint16_t opcode) {
@@ -3,7 +3,29 @@
 
 #include <cstdint>
 #include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
 #include "constants.h"
+#include "MegaDisplay.h"
+
+// Copy of the machine state that other threads can inspect while it runs
+struct Chip8State {
+	uint16_t pc;
+	uint32_t I;
+	uint8_t V[16];
+	uint16_t dTimer;
+	uint16_t sTimer;
+	bool hiRes;
+	bool megaMode;
+	uint64_t gfx[XO_NUM_PLANES][SCHIP_HEIGHT * CH8_ROW_WORDS];
+
+	// Instructions run since init
+	uint64_t cycles;
+
+	// How many snapshots were published before this one
+	uint32_t frame;
+};
 
 class Chip8 {
 
@@ -23,14 +45,75 @@ public:
 	// Passes input to emulator
 	void setKeys(bool a[]);
 
-	// Array that stores current state of pixels on 64 * 32 screen
-	uint8_t gfx[CH8_WIDTH][CH8_HEIGHT];
+	// Stores current state of pixels, one bit per pixel packed into rows, one bitplane per XO-CHIP plane
+	// Rows are getRowWords() uint64_t long and stored back to back, bit 63 of a row's first word is its leftmost pixel
+	// So in 64x32 mode a plane is just its first 32 words (256 bytes)
+	uint64_t gfx[XO_NUM_PLANES][SCHIP_HEIGHT * CH8_ROW_WORDS];
+
+	// Number of uint64_t in one display row in the current mode
+	int getRowWords() const { return hiRes ? CH8_ROW_WORDS : 1; }
+
+	// Get row y of a plane, getRowWords() long
+	const uint64_t* getRow(int plane, int y) const { return &gfx[plane][y << hiRes]; }
+
+	// Width and height of the display in the current mode
+	int getWidth() const { return hiRes ? SCHIP_WIDTH : CH8_WIDTH; }
+	int getHeight() const { return hiRes ? SCHIP_HEIGHT : CH8_HEIGHT; }
+
+	// Get the rows touched by DXYN, 00E0 and the scrolls since the last call, bit y for row y, then forget them
+	// A row can be marked even if it ended up unchanged, like a sprite erased and redrawn in the same place
+	// In MegaChip mode only 00E0 marks them, since that's when a finished frame becomes visible
+	uint64_t takeDirtyRows() { uint64_t rows = dirtyRows; dirtyRows = 0; return rows; }
+
+	// Check if SUPER-CHIP 128x64 mode is on
+	bool isHiRes() const { return hiRes; }
+
+	// Get the color index of the pixel at (x, y): bit 0 from the first plane, bit 1 from the second
+	int getPixel(int x, int y) const {
+		int i = (y << hiRes) + (x >> 6);
+		int shift = 63 - (x & 63);
+		return ((gfx[0][i] >> shift) & 1) | (((gfx[1][i] >> shift) & 1) << 1);
+	}
+
+	// Check if the program ran 00FD to exit
+	bool isHalted() const { return halted; }
+
+	// Instructions run since init
+	uint64_t getCycleCount() const { return cycleCount; }
+
+	// Check if the program switched to MegaChip mode with 0011
+	// While it's on, the display is getMegaDisplay() instead of gfx
+	bool isMegaChip() const { return megaMode; }
+	const MegaDisplay& getMegaDisplay() const { return *mega; }
+	MegaDisplay& getMegaDisplay() { return *mega; }
+
+	// Check if the program loaded an XO-CHIP audio pattern with F002
+	bool hasAudioPattern() const { return audioPatternSet; }
+
+	// The 128-bit XO-CHIP audio pattern, most significant bit of the first byte plays first
+	const uint8_t* getAudioPattern() const { return audioPattern; }
+
+	// Rate in Hz the audio pattern's bits play at, set by FX3A
+	double getPatternRate() const { return patternRate; }
 
 	// Loads ROM file into memory
 	int loadRom(std::string name);
 
+	// Read a ROM file into buffer without touching the machine, so it can be loaded later or on another thread
+	// quiet leaves out the message on stdout after a good read, for callers whose stdout is their report
+	static int readRom(const std::string& name, std::vector<char>& buffer, bool quiet = false);
+
+	// Copy a ROM read by readRom into memory at 0x200; call init first to start it from scratch
+	int loadProgram(const std::vector<char>& rom);
+
 	// Get current value of sound timer
 	uint16_t getSoundTimer() const { return sTimer; }
+	uint16_t getDelayTimer() const { return dTimer; }
+
+	// Registers, for whoever owns the machine; other threads should use readState
+	uint16_t getPC() const { return pc; }
+	uint32_t getI() const { return I; }
+	const uint8_t* getV() const { return V; }
 
 	// Check if the soundTimer was given a new value since it was last read
 	bool isAudioUpdated();
@@ -44,18 +127,35 @@ public:
 	// Check if sprite wrapping is on or off
 	bool wrapIsEnabled() { return wrapFlag; }
 
-	// Decrement the timers
-	void decrTimers();
+	// Decrement the timers once TARGET_FRAMETIME_MILLISECONDS of real time has passed
+	// Returns true if they were, which ends a frame
+	bool decrTimers();
+
+	// End a 60 Hz frame now: decrement the timers and publish the state
+	// For callers that schedule frames themselves instead of going by SDL_GetTicks
+	void tickTimers();
+
+	// Publish a snapshot of the current state for readState
+	// Only the thread running emulateCycle may call this; it's done automatically once per frame
+	void publishState();
+
+	// Copy the most recently published snapshot, safe to call from any thread
+	// Never blocks the emulation thread; returns false only if it kept racing the writer
+	bool readState(Chip8State& out) const;
 
 private:
 	// Hardware CHIP-8 is on typically has 4096 8-bit memory locations
-	uint8_t memory[CH8_MEM_SIZE];
+	// We have XO-CHIP's 64 KB, grown to a larger power of two when a MegaChip ROM needs it
+	std::vector<uint8_t> memory;
+
+	// memory.size() - 1, every computed address is masked with this
+	uint32_t addrMask;
 
 	// CHIP-8 has 16 8-bit data registers named V0 through VF
 	uint8_t V[16];
 
-	// CHIP-8 has address register I which is 16 bits wide
-	uint16_t I;
+	// CHIP-8 has address register I which is 16 bits wide (24 on MegaChip)
+	uint32_t I;
 
 	// Program Counter
 	uint16_t pc;
@@ -87,11 +187,81 @@ private:
 	// Clear the screen
 	void clearDisp();
 
+	// Clear only the planes selected in planeMask
+	void clearPlanes();
+
+	// Skip over the next instruction, which may be the 4-byte F000 NNNN or 01NN NNNN
+	void skipNext();
+
+	// XOR a sprite from addr onto one plane, returns true if any set pixel was cleared
+	// Wide sprites are 16 pixels across and read two bytes per row
+	bool drawSprite(int plane, uint16_t addr, uint8_t vx, uint8_t vy, int rows, bool wide);
+
+	// SUPER-CHIP and XO-CHIP scrolls of the selected planes, n is in pixels of the current mode
+	void scrollDown(int n);
+	void scrollUp(int n);
+	void scrollRight(int n);
+	void scrollLeft(int n);
+
+	// Rows of gfx written since takeDirtyRows last ran, one bit per row
+	uint64_t dirtyRows;
+	static_assert(SCHIP_HEIGHT <= 64, "dirtyRows needs a bit for every row");
+
+	// Set when the display is in SUPER-CHIP 128x64 mode
+	bool hiRes;
+
+	// Set by 00FD, no further instructions are run
+	bool halted;
+
+	// SUPER-CHIP RPL user flags, kept across init like the HP48's
+	uint8_t rplFlags[SCHIP_NUM_FLAGS];
+
+	// XO-CHIP planes that draws, clears and scrolls apply to, set by FN01
+	uint8_t planeMask;
+
+	// XO-CHIP audio pattern and pitch register
+	uint8_t audioPattern[XO_AUDIO_PATTERN_SIZE];
+	uint8_t pitch;
+	bool audioPatternSet;
+
+	// Playback rate derived from pitch, kept so the audio path doesn't call pow per sample
+	double patternRate;
+
+	// Recompute patternRate after pitch changes
+	void updatePatternRate();
+
+	// Set by 0011, DXYN and the scrolls go to mega instead of gfx
+	bool megaMode;
+
+	// MegaChip display, only allocated once a ROM turns MegaChip mode on
+	std::unique_ptr<MegaDisplay> mega;
+
+	// Run a 0NNN opcode with NNN >= 0x100, which MegaChip uses for its extensions
+	void megaOpcode(uint16_t opcode);
+
+	// Draw a MegaChip sprite from I using the size set by 03NN/04NN
+	bool drawMegaSprite(uint8_t vx, uint8_t vy);
+
 	// Increment program counter
 	void incrPC() { pc += 2; }
 
 	//
 	bool soundTimerIsUpdated;
+
+	// Two snapshot slots, the writer always fills the one readers aren't pointed at
+	Chip8State snapshots[2];
+
+	// Seqlock counter for each slot, odd while that slot is being written
+	std::atomic<uint32_t> snapshotSeq[2];
+
+	// Slot holding the most recent complete snapshot
+	std::atomic<int> latestSnapshot;
+
+	// Number of snapshots published since init
+	uint32_t snapshotCount;
+
+	// Instructions run since init
+	uint64_t cycleCount;
 };
 
 #endif
\ No newline at end of file
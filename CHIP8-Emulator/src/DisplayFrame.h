@@ -0,0 +1,42 @@
+#ifndef DISPLAYFRAME_H
+#define DISPLAYFRAME_H
+
+#include <cstdint>
+#include <vector>
+#include "constants.h"
+
+// Everything needed to show one frame, copied out of Chip8 so it can be drawn without touching the machine
+struct DisplayFrame {
+	// Same layout as Chip8::gfx
+	uint64_t gfx[XO_NUM_PLANES][SCHIP_HEIGHT * CH8_ROW_WORDS];
+
+	bool hiRes;
+	bool megaMode;
+
+	// Composed MegaChip frame, MEGA_WIDTH * MEGA_HEIGHT ARGB pixels, only filled in while megaMode is set
+	std::vector<uint32_t> mega;
+
+	// Rows copied in since the previous capture, bit y for row y
+	uint64_t dirty;
+
+	// SDL_GetPerformanceCounter() when the frame was finished
+	uint64_t time;
+
+	int getWidth() const { return megaMode ? MEGA_WIDTH : hiRes ? SCHIP_WIDTH : CH8_WIDTH; }
+	int getHeight() const { return megaMode ? MEGA_HEIGHT : hiRes ? SCHIP_HEIGHT : CH8_HEIGHT; }
+	int getRowWords() const { return hiRes ? CH8_ROW_WORDS : 1; }
+	const uint64_t* getRow(int plane, int y) const { return &gfx[plane][y << hiRes]; }
+
+	// MegaChip shown at SCHIP_WIDTH x SCHIP_HEIGHT takes every other pixel across and every third down
+	// Row y of that out of a composed frame, read with megaSample; the static one is for frames outside a DisplayFrame
+	static const uint32_t* megaSampleRow(const uint32_t* mega, int y) { return mega + y * (MEGA_HEIGHT / SCHIP_HEIGHT) * MEGA_WIDTH; }
+	const uint32_t* megaSampleRow(int y) const { return megaSampleRow(mega.data(), y); }
+	static uint32_t megaSample(const uint32_t* row, int x) { return row[x * (MEGA_WIDTH / SCHIP_WIDTH)]; }
+
+	// Whether a MegaChip pixel counts as on where only on and off can be shown: brighter than dark gray
+	static bool isLit(uint32_t argb) {
+		return ((((argb >> 16) & 0xFF) * 2 + ((argb >> 8) & 0xFF) * 5 + (argb & 0xFF)) >> 3) > 0x40;
+	}
+};
+
+#endif
@@ -3,16 +3,52 @@
 
 #include <string>
 #include "Chip8.h"
+#include "DisplayFrame.h"
+#include "PixelExpander.h"
+#include "PixelScaler.h"
+#include "PhosphorFilter.h"
+#include "Hud.h"
+#include "TerminalRenderer.h"
+#include "ScreenshotWriter.h"
+#include "FrameBus.h"
+#include "VideoCapture.h"
+#include "SharedFrame.h"
+#include "StreamServer.h"
+#include "CallbackAudio.h"
+#include "TripleBuffer.h"
 #include <SDL.h>
 #include "constants.h"
 #include <vector>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <chrono>
 
 const int DISABLE_WRAP = 0x01;
 const int DISABLE_THROTTLE = 0x02;
 const int DISABLE_SDL_DELAY = 0x04;
+const int ENABLE_VSYNC = 0x08;
+const int ENABLE_FRAME_BLEND = 0x10;
+const int ENABLE_EMU_THREAD = 0x20;
+const int ENABLE_OFFSCREEN = 0x40;
 const int ENABLE_WRAP = 0x0;
 const int ENABLE_THROTTLE = 0x0;
 const int ENABLE_SDL_DELAY = 0x0;
+const int DISABLE_VSYNC = 0x0;
+const int DISABLE_FRAME_BLEND = 0x0;
+const int DISABLE_EMU_THREAD = 0x0;
+const int DISABLE_OFFSCREEN = 0x0;
+
+// Count, average and worst case of a duration measured over and over, in milliseconds
+struct TimingStats {
+	unsigned long count;
+	double total;
+	double worst;
+
+	void reset() { count = 0; total = 0; worst = 0; }
+	void add(double ms) { ++count; total += ms; if (ms > worst) worst = ms; }
+	double average() const { return count ? total / count : 0; }
+};
 
 
 class Emulator {
@@ -22,8 +58,13 @@ public:
 	// Specify flags when constructing
 	// Use OR to combine flags
 	// AVAILABLE FLAGS:
-	// DISABLE_WRAP, DISABLE_THROTTLE, DISABLE_SDL_DELAY
-	// ENABLE_WRAP, ENABLE_THROTTLE, ENABLE_SDL_DELAY
+	// DISABLE_WRAP, DISABLE_THROTTLE, DISABLE_SDL_DELAY, DISABLE_VSYNC, DISABLE_FRAME_BLEND, DISABLE_EMU_THREAD, DISABLE_OFFSCREEN
+	// ENABLE_WRAP, ENABLE_THROTTLE, ENABLE_SDL_DELAY, ENABLE_VSYNC, ENABLE_FRAME_BLEND, ENABLE_EMU_THREAD, ENABLE_OFFSCREEN
+	// With ENABLE_VSYNC the screen is presented every display refresh and the game runs on its own 60 Hz clock
+	// ENABLE_FRAME_BLEND additionally crossfades between game frames when the refresh rate isn't a multiple of 60
+	// ENABLE_EMU_THREAD runs the game on a thread of its own, leaving this one to handle events and draw
+	// ENABLE_OFFSCREEN draws into memory with SDL's software renderer and starts only SDL's event subsystem,
+	// for machines with no display or sound; use runHeadless to run it
 	Emulator(uint16_t flags);
 
 	// Destructor
@@ -38,6 +79,55 @@ public:
 	// Specify game
 	int runGame(std::string path);
 
+	// Run a game for a number of 60 Hz frames as fast as possible, drawing into memory (ENABLE_OFFSCREEN only)
+	// The picture is what the window would show at its default size
+	int runHeadless(int frames);
+	int runHeadless(std::string path, int frames);
+
+	// Switch between roms count times (ENABLE_OFFSCREEN only), running and drawing a frame of each, and
+	// print how long swapRom took and how resident memory moved; fails with ERR_STRESS_GROWTH if it
+	// grew more than STRESS_SWAP_MAX_GROWTH_KB after the first STRESS_SWAP_WARMUP switches
+	int stressSwap(const std::vector<std::string>& roms, int count);
+
+	// The offscreen picture, ARGB8888 at the window's size, or NULL before runHeadless
+	const SDL_Surface* getOffscreenSurface() const { return m_offscreenSurface; }
+
+	// Write the offscreen picture to a BMP file
+	int saveScreenshot(const std::string& path);
+
+	// Queue a PNG of the frame last shown, written on a background thread; an empty path picks a numbered name
+	// Returns false if too many are already waiting, never blocks
+	bool takeScreenshot(const std::string& path = "");
+
+	// Record every 60 Hz frame from the next runGame or runHeadless on as Y4M, to path or "-" for stdout
+	// Runs on a writer thread and stops when the run ends; see VideoCapture for scale and timecodes
+	int startCapture(const std::string& path, int scale, const std::string& timecodePath = "");
+
+	// Publish the display, frame count and V, I and pc at the end of every frame into shared memory
+	// under name (see SharedFrameLayout), until the emulator is destroyed
+	int startSharedExport(const std::string& name);
+
+	// Stream the display to viewers on address (a localhost port, or unix:<path>) and take their keys,
+	// which are combined with this keyboard's, until the emulator is destroyed
+	int startStreamServer(const std::string& address);
+
+	// Make the tone in an audio callback instead of queueing it, heard latencyMs after the frame that
+	// started or stopped it; latency can go down to one device buffer, see CallbackAudio
+	int useCallbackAudio(double latencyMs);
+
+	// Queue a frame's worth of samples frames times, the old way, one SDL_QueueAudio per sample, and
+	// the block way through queueAudio, and print how long each took; the device plays, at no volume
+	int benchAudio(int frames);
+
+	// Print how long after launch the next run presents its first frame, then quit the run
+	// launch is when whatever started this process read steady_clock, which every process shares
+	void probeStartup(std::chrono::steady_clock::time_point launch);
+
+	// Switch to another ROM, keeping the window, renderer, textures and audio device
+	// Only the machine is reset; while the emulation thread runs it switches at the start of its next frame
+	// Call from the thread that called runGame, or between runGame calls
+	int swapRom(const std::string& path);
+
 	// Reset all values
 	void reset();
 
@@ -50,35 +140,260 @@ public:
 	// Toggle gamespeed throttle
 	void toggleThrottle() { m_throttleSpeed = !m_throttleSpeed; }
 
+	// Pick a CPU upscaling filter (ScaleFilter) to run before the renderer scales to the window
+	// Only applies to CHIP-8/SUPER-CHIP/XO-CHIP displays, MegaChip frames are shown as they are
+	void setScaleFilter(int filter);
+
+	// Mix each shown frame with the ones before it, weights newest first; count 0 turns it off
+	// Runs after the scaling filter, on what would otherwise go straight to the texture
+	void setPhosphor(const int* weights, int count);
+
+	// Draw in this terminal with ANSI escapes instead of opening a window (TerminalStyle), TERM_NONE for the window
+	// Set before runGame; input still comes through SDL, so over SSH the game can be watched but not played
+	void setTerminalStyle(int style);
+
+	// Show or hide the performance overlay; needs a TTF font, from setHudFont or else at HUD_FONT_PATH
+	void toggleHud() { m_showHud = !m_showHud; }
+
+	// Font for the overlay, loaded the first time it's shown; a new path gets another try after a failed one
+	void setHudFont(const std::string& path) { m_hudFont = path; m_hudFailed = false; }
+
+	// Toggle crossfading between game frames, only has an effect with vsync
+	void toggleFrameBlend() { m_frameBlend = !m_frameBlend; }
+
+	// Copy the CHIP-8 state as of the last completed frame
+	// Safe to call from any thread while runGame is running
+	bool readChipState(Chip8State& out) const { return chip.readState(out); }
+
+	// Translate keyboard input to CHIP-8 buttons
+	static void mapKeys(const uint8_t* ks, bool keys[]);
+
+	// Frames sent to the screen, and frames skipped because they matched what was already there
+	unsigned long getPresentedFrames() const { return m_totalFrames; }
+	unsigned long getSkippedPresents() const { return m_skippedPresents; }
+
 private:
 	Chip8 chip;
 	std::string m_gamePath;
 
 	// SDL visual stuff
 	SDL_Window* m_gameWindow;
+
+	// What the software renderer draws into instead of a window (ENABLE_OFFSCREEN)
+	bool m_offscreen;
+	SDL_Surface* m_offscreenSurface;
 	SDL_Renderer* m_renderer;
 	SDL_Texture* m_texture;
 
+	// Previous game frame, shown under m_texture while frame blending
+	SDL_Texture* m_prevTexture;
+
 	// Window properties
 	int m_width, m_height, m_scaleWidth, m_scaleHeight;
 
+	// Guest resolution the renderer is currently scaling from
+	int m_logicalWidth, m_logicalHeight;
+
+	// Color for each combination of XO-CHIP plane bits, 0xAARRGGBB
+	uint32_t m_palette[1 << XO_NUM_PLANES];
+
+	// Converts the packed display to texture pixels through m_palette
+	PixelExpander m_expander;
+
+	// Optional Scale2x/Scale3x/EPX pass, keeps its output between frames so only changed rows are redone
+	PixelScaler m_scaler;
+
+	// Optional phosphor persistence pass, fed full ARGB frames from m_phosphorFrame
+	PhosphorFilter m_phosphor;
+	std::vector<uint32_t> m_phosphorFrame;
+
+	// When the last frame went into m_phosphor, so fading continues at 60 Hz between game frames
+	uint64_t m_lastPhosphorPush;
+
+	// Display rows as they were last uploaded, to tell real changes from rows redrawn the same
+	uint64_t m_shownGfx[XO_NUM_PLANES][SCHIP_HEIGHT * CH8_ROW_WORDS];
+
+	// Upload and present every row on the next drawScreen, whatever the dirty rows say
+	bool m_fullRedraw;
+
 	// How many frames have elapsed
 	unsigned long m_totalFrames;
-	bool m_paused;
-	bool m_throttleSpeed;
+
+	// How many drawScreen calls found nothing new to show, and how many rows went up in total
+	unsigned long m_skippedPresents;
+	unsigned long m_uploadedRows;
+	std::atomic<bool> m_paused;
+	std::atomic<bool> m_throttleSpeed;
 	bool m_useSDLdelay;
+
+	// Present on every display refresh and schedule game frames separately
+	bool m_vsync;
+
+	// Crossfade between the last two game frames by how far into the next one the refresh lands
+	bool m_frameBlend;
+
+	// Display refresh rate in Hz, 0 if SDL couldn't tell
+	int m_refreshRate;
+
+	// Game time owed but not yet run, in seconds, and the counter value it was last advanced at
+	double m_frameAccumulator;
+	uint64_t m_lastRefresh;
+
+	// Copy of the display drawScreen works from when everything runs on one thread
+	DisplayFrame m_localFrame;
+
+	// Emulation thread (ENABLE_EMU_THREAD)
+	// Chip8 belongs to that thread while it runs; input and settings cross over through the atomics below
+	bool m_useEmuThread;
+	std::thread m_emuThread;
+	std::atomic<bool> m_emuRunning;
+
+	// Finished frames on their way from the emulation thread to this one
+	TripleBuffer<DisplayFrame> m_frames;
+
+	// ROM read by swapRom, waiting for the emulation thread to load it
+	std::vector<char> m_pendingRom;
+	std::mutex m_pendingLock;
+	std::atomic<bool> m_romPending;
+
+	// Pressed CHIP-8 keys, bit n for key n, speed multiplier and sprite wrap, all set by the event loop
+	// The speed is also shown on the HUD in every mode
+	std::atomic<uint16_t> m_keyMask;
+	std::atomic<double> m_emuSpeed;
+	std::atomic<bool> m_spriteWrap;
+
+	// How late each game frame started and how long it took, on the emulation thread
+	TimingStats m_emuLateness;
+	TimingStats m_emuWork;
+
+	// How long each upload and present took on the render thread
+	TimingStats m_renderWork;
 	double m_previousFPS[MAX_STORED_FPS_VALS];
 	int m_numStoredFPS;
 
+	// Next slot of m_previousFPS to write
+	int m_fpsIndex;
+
+	// Draws instead of the window when a terminal style is set
+	TerminalRenderer m_terminal;
+
+	// PNG screenshots, and how many have been named so far
+	ScreenshotWriter m_screenshots;
+	unsigned long m_screenshotCount;
+
+	// Video of every frame, and the stream of it, both fed through m_bus
+	VideoCapture m_capture;
+	StreamServer m_stream;
+
+	// Shared memory copy of every frame; a seqlock never waits on readers, so it's written straight from publishFrame
+	SharedFrameExport m_sharedFrame;
+
+	// Finished frames on their way to the sinks above, declared after them so it stops delivering first
+	FrameBus m_bus;
+
+	// Performance overlay
+	Hud m_hud;
+	bool m_showHud;
+	std::string m_hudFont;
+
+	// Set when the font couldn't be loaded, so it isn't retried every frame
+	bool m_hudFailed;
+
+	// Recent time between presents in ms, as a ring, for the percentiles
+	std::vector<float> m_frameTimes;
+	int m_frameTimeIndex;
+	int m_frameTimeCount;
+	uint64_t m_lastPresentTime;
+
+	// Set by probeStartup until the first present, and when whatever started this process took the time
+	bool m_probeStartup;
+	std::chrono::steady_clock::time_point m_launchTime;
+
+	// Counter value, instruction count and frame count at the last HUD refresh
+	uint64_t m_hudUpdated;
+	uint64_t m_hudCycles;
+	unsigned long m_hudFrames;
+
+	// Create the window, renderer and textures if they don't exist yet
+	int createWindow();
+
+	// Free them again, before SDL_Quit
+	void destroyWindow();
+
+	// Finish the capture, if there is one, and say how it went
+	void stopCapture();
+
+	// Start the machine over with a new ROM, keeping settings like sprite wrap; called by whoever owns chip
+	int restartGuest(const std::vector<char>& rom);
+
+	// Emulation thread side of swapRom
+	void applyPendingRom();
+
 	// Refresh the screen with what is currently in the Chip 8's gfx array
+	// Only rows that differ from the last upload are sent, and nothing is presented if none do
 	void drawScreen();
 
+	// Copy the given rows of the display, and the MegaChip frame if it has a new one, into f
+	void captureFrame(DisplayFrame& f, uint64_t rows);
+
+	// Bring the texture up to date with f, returns false if nothing changed
+	bool updateTexture(const DisplayFrame& f);
+
+	// Draw the texture to the window and show it, blending over the previous frame by weight (0-255)
+	void present(int weight);
+
+	// Expand rows [first, last] of f into the texture
+	void uploadRows(const DisplayFrame& f, int first, int last);
+
+	// Run whatever game frames are due and present once, called every display refresh in vsync mode
+	void vsyncStep(double speed);
+
+	// Run one 60 Hz game frame: CYCLES_PER_FRAME instructions, then the timers
+	void runGuestFrame();
+
+	// Hand the frame that just ended to the bus and the shared memory export, on whichever thread owns chip
+	void publishFrame();
+
+	// Start or stop the audio device to follow the sound timer
+	void updateSoundGate();
+
+	// Queue one game frame's worth of samples
+	void queueFrameAudio();
+
+	// Body of the emulation thread: runs game frames at 60 Hz and publishes the ones that drew something
+	void emulationLoop();
+
+	// Render thread side: pass input over, draw the newest frame if there is one
+	void renderStep(const uint8_t* ks);
+
+	// Print how both threads kept up
+	void printThreadTimings();
+
+	// Say how the callback audio kept up, if it was used
+	void printAudioTimings();
+
+	// Push f into the phosphor history and write the mix to the texture
+	// Unchanged frames are only pushed while the history is still fading, returns false if nothing was written
+	bool updatePhosphor(const DisplayFrame& f, bool changed);
+
+	// Copy a composed MegaChip frame into the streaming texture
+	void uploadMegaScreen(const DisplayFrame& f);
+
 	// Send keyboard input to Chip 8
 	void sendInput(const uint8_t* ks, bool keys[]);
 
 	// Get average FPS of last 10 frames
 	double getFPS();
 
+	// Note how long it's been since the last present, for getFPS and the HUD
+	void recordFrameTime();
+
+	// Draw the overlay on top of the game, refreshing its numbers every HUD_UPDATE_MS
+	void drawHud();
+
+	// Rebuild the overlay text from the counters
+	void updateHudText(uint64_t now);
+
 	// Initialize
 	void init();
 
@@ -89,8 +404,11 @@ private:
 	// Modifies the sound volume
 	int m_gain;
 
+	// Takes over from the queue when open, m_audioDev is then its device
+	CallbackAudio m_callbackAudio;
+
 	// Store whether noise is being played or not
-	bool m_isPlayingSound;
+	std::atomic<bool> m_isPlayingSound;
 
 	// How we'll represent our sound wave
 	struct Wave {
@@ -104,14 +422,20 @@ private:
 		std::vector<int16_t> sampleVals;
 	} m_square;
 
-	// Buffer s seconds of sound
-	void fillAudioQueue(int s);
+	// Position in the XO-CHIP audio pattern, in bits
+	double m_patternPos;
 
 	// Load a single cyle of a wave at a given frequency
 	void setupWave();
 
-	// Push a single sample to SDL
-	void pushSample();
+	// Samples waiting to be queued, sized in init for the biggest block so generating never allocates
+	std::vector<int16_t> m_audioBlock;
+
+	// Write the next n samples of the beep, or of the XO-CHIP pattern if the game set one, to out
+	void generateAudio(int16_t* out, int n);
+
+	// Generate up to n samples and hand them to SDL in one call each block
+	void queueAudio(long n);
 };
 
 #endif
\ No newline at end of file
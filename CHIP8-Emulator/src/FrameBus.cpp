@@ -0,0 +1,271 @@
+#include "FrameBus.h"
+#include <cstring>
+#include <SDL.h>
+#include "Chip8.h"
+
+FrameBus::FrameBus() {
+	m_sinkCount = 0;
+	m_blockCount = 0;
+	m_dispatched = 0;
+	m_number = 0;
+}
+
+FrameBus::~FrameBus() {
+	while (!m_sinks.empty())
+		removeSink(m_sinks.back()->sink);
+
+	if (m_dispatch)
+		stop(*m_dispatch);
+}
+
+std::unique_ptr<FrameBus::Sink> FrameBus::makeSink(FrameSink* sink, int policy, int depth) {
+	if (depth < 1)
+		depth = 1;
+
+	std::unique_ptr<Sink> s(new Sink());
+	s->sink = sink;
+	s->policy = policy;
+	s->queue.assign(depth, NULL);
+	s->first = 0;
+	s->count = 0;
+	s->stopping = false;
+	s->dropped = 0;
+	s->blocked = 0;
+	s->last = m_number;
+
+	// A sink holds at most depth frames waiting and one it's working on, and publish one more on top of
+	// all of them, so growing the pool by that much here means taking a frame can never come up empty
+	std::lock_guard<std::mutex> lock(m_poolLock);
+	const int frames = m_pool.empty() ? depth + 2 : depth + 1;
+	for (int i = 0; i < frames; i++) {
+		m_pool.emplace_back(new Frame());
+		m_pool.back()->refs = 0;
+		m_free.push_back(m_pool.back().get());
+	}
+	return s;
+}
+
+void FrameBus::addSink(FrameSink* sink, int policy, int depth) {
+	std::unique_ptr<Sink> s = makeSink(sink, policy, depth);
+	s->thread = std::thread(&FrameBus::run, this, s.get());
+
+	if (policy == FRAME_BLOCK) {
+		// The dispatch queue is only made for the first, and stays until the bus goes
+		if (!m_dispatch) {
+			m_dispatch = makeSink(NULL, FRAME_DROP_NEWEST, FRAME_BUS_DISPATCH_DEPTH);
+			m_dispatch->thread = std::thread(&FrameBus::run, this, m_dispatch.get());
+		}
+
+		std::lock_guard<std::mutex> lock(m_blockLock);
+		m_blockSinks.push_back(s.get());
+		++m_blockCount;
+	}
+
+	std::lock_guard<std::mutex> lock(m_sinkLock);
+	m_sinks.push_back(std::move(s));
+	++m_sinkCount;
+}
+
+void FrameBus::removeSink(FrameSink* sink) {
+	std::unique_ptr<Sink> s;
+	{
+		std::lock_guard<std::mutex> lock(m_sinkLock);
+		for (size_t i = 0; i < m_sinks.size(); i++) {
+			if (m_sinks[i]->sink == sink) {
+				s = std::move(m_sinks[i]);
+				m_sinks.erase(m_sinks.begin() + i);
+				--m_sinkCount;
+				break;
+			}
+		}
+	}
+	if (!s)
+		return;
+
+	if (s->policy == FRAME_BLOCK) {
+		// Frames published up to now may still be waiting for the dispatch thread; once it has got past
+		// them, or has nothing left, whatever it's offering when the lock comes free is the last this sink gets
+		const uint64_t published = m_number;
+		{
+			std::unique_lock<std::mutex> lock(m_dispatch->lock);
+			m_dispatchDone.wait(lock, [this, published] { return m_dispatched >= published || m_dispatch->count == 0; });
+		}
+
+		std::lock_guard<std::mutex> lock(m_blockLock);
+		for (size_t i = 0; i < m_blockSinks.size(); i++) {
+			if (m_blockSinks[i] == s.get()) {
+				m_blockSinks.erase(m_blockSinks.begin() + i);
+				--m_blockCount;
+				break;
+			}
+		}
+	}
+
+	// Out of the lists, so nothing can offer it frames any more; its thread empties the queue before it ends
+	stop(*s);
+
+	// Its share of the pool stays, there for the next sink added
+}
+
+void FrameBus::stop(Sink& s) {
+	{
+		std::lock_guard<std::mutex> lock(s.lock);
+		s.stopping = true;
+	}
+	s.wake.notify_one();
+	s.thread.join();
+}
+
+void FrameBus::publish(const Chip8& chip) {
+	if (m_sinkCount == 0)
+		return;
+
+	std::lock_guard<std::mutex> sinks(m_sinkLock);
+	if (m_sinks.empty())
+		return;
+
+	Frame* f;
+	{
+		std::lock_guard<std::mutex> lock(m_poolLock);
+		if (m_free.empty())
+			return;
+		f = m_free.back();
+		m_free.pop_back();
+	}
+
+	// publish holds a reference of its own until every sink has been offered the frame
+	capture(chip, f->frame);
+	f->number = ++m_number;
+	f->refs = 1;
+
+	// FRAME_BLOCK sinks get it from the dispatch thread, which drops it for all of them if it's full
+	for (std::unique_ptr<Sink>& s : m_sinks)
+		if (s->policy != FRAME_BLOCK)
+			offer(*s, f);
+	if (m_blockCount > 0)
+		offer(*m_dispatch, f);
+	release(f);
+}
+
+void FrameBus::capture(const Chip8& chip, DisplayFrame& f) {
+	f.hiRes = chip.isHiRes();
+	f.megaMode = chip.isMegaChip();
+	f.time = SDL_GetPerformanceCounter();
+	f.dirty = ~0ULL;
+
+	// Composed by 00E0, so this is the picture the screen shows for the same frame
+	// Pooled frames keep their buffer, so this only allocates the first time a frame sees MegaChip
+	if (f.megaMode) {
+		const uint32_t* pixels = chip.getMegaDisplay().getComposed();
+		f.mega.assign(pixels, pixels + MEGA_WIDTH * MEGA_HEIGHT);
+		return;
+	}
+
+	// Rows are back to back, so the whole display is one copy per plane
+	const size_t words = (size_t)chip.getRowWords() * chip.getHeight();
+	for (int p = 0; p < XO_NUM_PLANES; p++)
+		memcpy(f.gfx[p], chip.getRow(p, 0), words * sizeof(uint64_t));
+}
+
+void FrameBus::offer(Sink& s, Frame* f) {
+	const int depth = (int)s.queue.size();
+	Frame* dropped = NULL;
+	{
+		std::unique_lock<std::mutex> lock(s.lock);
+		if (s.count == depth) {
+			if (s.policy == FRAME_BLOCK) {
+				++s.blocked;
+				s.space.wait(lock, [&s, depth] { return s.count < depth; });
+			}
+			else if (s.policy == FRAME_DROP_OLDEST) {
+				dropped = s.queue[s.first];
+				s.first = (s.first + 1) % depth;
+				--s.count;
+				++s.dropped;
+			}
+			else {
+				++s.dropped;
+				return;
+			}
+		}
+
+		f->refs.fetch_add(1, std::memory_order_relaxed);
+		s.queue[(s.first + s.count) % depth] = f;
+		++s.count;
+	}
+	s.wake.notify_one();
+
+	if (dropped != NULL)
+		release(dropped);
+}
+
+void FrameBus::dispatch(Frame* f) {
+	{
+		std::lock_guard<std::mutex> lock(m_blockLock);
+		for (Sink* s : m_blockSinks) {
+			// Frames the dispatch queue dropped never reach here, so they're counted against each sink now
+			if (f->number > s->last + 1)
+				s->dropped += (unsigned long)(f->number - s->last - 1);
+			s->last = f->number;
+			offer(*s, f);
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(m_dispatch->lock);
+		m_dispatched = f->number;
+	}
+	m_dispatchDone.notify_all();
+}
+
+void FrameBus::release(Frame* f) {
+	if (f->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+		return;
+
+	std::lock_guard<std::mutex> lock(m_poolLock);
+	m_free.push_back(f);
+}
+
+void FrameBus::run(Sink* s) {
+	const int depth = (int)s->queue.size();
+	std::unique_lock<std::mutex> lock(s->lock);
+
+	while (true) {
+		s->wake.wait(lock, [s] { return s->count > 0 || s->stopping; });
+		if (s->count == 0)
+			break;
+
+		// Taken off the queue before it's delivered, so a blocked dispatch can go on right away
+		Frame* f = s->queue[s->first];
+		s->first = (s->first + 1) % depth;
+		--s->count;
+		lock.unlock();
+		s->space.notify_one();
+
+		// The dispatch queue is the only one with no sink of its own
+		if (s->sink == NULL)
+			dispatch(f);
+		else s->sink->consumeFrame(f->frame, f->number);
+		release(f);
+		lock.lock();
+	}
+}
+
+FrameBus::Sink* FrameBus::find(const FrameSink* sink) {
+	for (std::unique_ptr<Sink>& s : m_sinks)
+		if (s->sink == sink)
+			return s.get();
+	return NULL;
+}
+
+unsigned long FrameBus::getDropped(const FrameSink* sink) {
+	std::lock_guard<std::mutex> lock(m_sinkLock);
+	Sink* s = find(sink);
+	return s ? s->dropped.load() : 0;
+}
+
+unsigned long FrameBus::getBlocked(const FrameSink* sink) {
+	std::lock_guard<std::mutex> lock(m_sinkLock);
+	Sink* s = find(sink);
+	return s ? s->blocked.load() : 0;
+}
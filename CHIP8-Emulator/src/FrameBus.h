@@ -0,0 +1,146 @@
+#ifndef FRAMEBUS_H
+#define FRAMEBUS_H
+
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "DisplayFrame.h"
+#include "constants.h"
+
+class Chip8;
+
+// Something that takes every finished frame at its own pace, see FrameBus
+class FrameSink {
+public:
+	virtual ~FrameSink() {}
+
+	// Called on the sink's own thread, in order; number counts every frame published, so a gap
+	// since the last one is how many this sink had dropped
+	virtual void consumeFrame(const DisplayFrame& frame, uint64_t number) = 0;
+};
+
+// What publish does when a sink's queue is full
+enum FramePolicy {
+	FRAME_BLOCK,          // Wait for room, for sinks that want every frame; the bus's dispatch thread does the
+	                      // waiting, and only drops frames if FRAME_BUS_DISPATCH_DEPTH of them back up behind it
+	FRAME_DROP_OLDEST,    // Make room by dropping the oldest waiting frame, for sinks that want the latest
+	FRAME_DROP_NEWEST     // Drop the new frame, for sinks that want an unbroken run of older ones
+};
+
+// Hands each finished frame to any number of sinks, each on a thread of its own
+// A frame is captured once into a pooled buffer and shared by reference; the last sink done with it
+// puts it back. The pool is sized when sinks are added, so publishing never allocates, and a sink
+// that falls behind only ever loses frames of its own
+// publish never waits: FRAME_BLOCK sinks are fed by a dispatch thread of the bus's own, so a slow one
+// holds up the other FRAME_BLOCK sinks but never the thread that owns chip
+class FrameBus {
+public:
+	FrameBus();
+
+	// Delivers what's queued, then stops every sink's thread
+	~FrameBus();
+
+	// Deliver frames to sink on a new thread, up to depth of them waiting, with a FramePolicy for when
+	// there are more; sink has to outlive its registration
+	void addSink(FrameSink* sink, int policy, int depth);
+
+	// Deliver what's queued for sink, including frames published before the call that are still
+	// waiting to be dispatched to it, then stop its thread
+	void removeSink(FrameSink* sink);
+
+	bool hasSinks() const { return m_sinkCount > 0; }
+
+	// Capture the display at the end of a frame and offer it to every sink, from whichever thread owns chip
+	void publish(const Chip8& chip);
+
+	// Frames published since the first sink was added
+	uint64_t getPublished() const { return m_number; }
+
+	// Frames dropped for sink, and how many times a frame had to wait for room in its queue
+	unsigned long getDropped(const FrameSink* sink);
+	unsigned long getBlocked(const FrameSink* sink);
+
+private:
+	// A pooled frame and how many holders it has left
+	struct Frame {
+		DisplayFrame frame;
+		uint64_t number;
+		std::atomic<int> refs;
+	};
+
+	struct Sink {
+		FrameSink* sink;
+		int policy;
+
+		// Ring of frames waiting, count of them from first
+		std::vector<Frame*> queue;
+		int first, count;
+
+		std::mutex lock;
+		std::condition_variable wake;
+		std::condition_variable space;
+		std::thread thread;
+		bool stopping;
+
+		std::atomic<unsigned long> dropped;
+		std::atomic<unsigned long> blocked;
+
+		// FRAME_BLOCK only: the number of the last frame dispatched to it, so the dispatch thread can
+		// count the frames it dropped before they got here
+		uint64_t last;
+	};
+
+	// Guards the list of sinks against publish
+	std::mutex m_sinkLock;
+	std::vector<std::unique_ptr<Sink>> m_sinks;
+	std::atomic<int> m_sinkCount;
+
+	// The FRAME_BLOCK sinks, also in m_sinks; the dispatch thread holds m_blockLock while it offers to them
+	std::mutex m_blockLock;
+	std::vector<Sink*> m_blockSinks;
+	std::atomic<int> m_blockCount;
+
+	// Queue of frames for the FRAME_BLOCK sinks, run like a FRAME_DROP_NEWEST sink of its own, made with
+	// the first of them; m_dispatched is the number of the last frame it handed out, under its lock
+	std::unique_ptr<Sink> m_dispatch;
+	uint64_t m_dispatched;
+	std::condition_variable m_dispatchDone;
+
+	// Every frame ever made, and the ones not held by anyone
+	std::mutex m_poolLock;
+	std::vector<std::unique_ptr<Frame>> m_pool;
+	std::vector<Frame*> m_free;
+
+	std::atomic<uint64_t> m_number;
+
+	// Copy the display as it is into f
+	static void capture(const Chip8& chip, DisplayFrame& f);
+
+	// Queue f for s according to its policy; FRAME_BLOCK waits for room, so only the dispatch thread
+	// offers to those
+	void offer(Sink& s, Frame* f);
+
+	// Dispatch thread: offer f to every FRAME_BLOCK sink
+	void dispatch(Frame* f);
+
+	// Drop a reference to f, returning it to the pool with the last one
+	void release(Frame* f);
+
+	// Sink and dispatch thread: deliver queued frames until stopped and empty
+	void run(Sink* s);
+
+	// A sink with its queue set up and no thread yet, and enough frames added to the pool for it
+	std::unique_ptr<Sink> makeSink(FrameSink* sink, int policy, int depth);
+
+	// Let s's thread empty its queue, then join it
+	static void stop(Sink& s);
+
+	// The registration for sink, NULL if there isn't one; m_sinkLock has to be held
+	Sink* find(const FrameSink* sink);
+};
+
+#endif
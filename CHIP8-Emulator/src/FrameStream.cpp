@@ -0,0 +1,522 @@
+#include "FrameStream.h"
+#include <cstring>
+#include <cstdlib>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+static const char STREAM_MAGIC[4] = { 'C', '8', 'S', 'T' };
+
+// Bytes in front of every payload: type and length
+static const int STREAM_HEADER_SIZE = 5;
+
+static void putLittleEndian(std::vector<uint8_t>& out, uint32_t v, int bytes) {
+	for (int i = 0; i < bytes; i++)
+		out.push_back((uint8_t)(v >> (i * 8)));
+}
+
+static uint32_t getLittleEndian(const uint8_t* p, int bytes) {
+	uint32_t v = 0;
+	for (int i = 0; i < bytes; i++)
+		v |= (uint32_t)p[i] << (i * 8);
+	return v;
+}
+
+void FrameStream::convert(const DisplayFrame& src, DisplayFrame& f) {
+	f.megaMode = false;
+
+	if (src.megaMode) {
+		// Sent as a hi-res frame, one plane of the pixels that are lit
+		f.hiRes = true;
+		memset(f.gfx, 0, sizeof(f.gfx));
+		for (int y = 0; y < SCHIP_HEIGHT; y++) {
+			const uint32_t* row = src.megaSampleRow(y);
+			for (int x = 0; x < SCHIP_WIDTH; x++)
+				if (DisplayFrame::isLit(DisplayFrame::megaSample(row, x)))
+					f.gfx[0][y * CH8_ROW_WORDS + (x >> 6)] |= 1ULL << (63 - (x & 63));
+		}
+		return;
+	}
+
+	f.hiRes = src.hiRes;
+	const size_t words = (size_t)src.getRowWords() * src.getHeight();
+	for (int p = 0; p < XO_NUM_PLANES; p++)
+		memcpy(f.gfx[p], src.gfx[p], words * sizeof(uint64_t));
+}
+
+bool FrameStream::sameFrame(const DisplayFrame& a, const DisplayFrame& b) {
+	if (a.hiRes != b.hiRes)
+		return false;
+
+	const size_t words = (size_t)a.getRowWords() * a.getHeight();
+	for (int p = 0; p < XO_NUM_PLANES; p++)
+		if (memcmp(a.gfx[p], b.gfx[p], words * sizeof(uint64_t)) != 0)
+			return false;
+	return true;
+}
+
+size_t FrameStream::beginMessage(int type, std::vector<uint8_t>& out) {
+	out.push_back((uint8_t)type);
+	size_t start = out.size();
+	putLittleEndian(out, 0, 4);
+	return start;
+}
+
+void FrameStream::endMessage(size_t start, std::vector<uint8_t>& out) {
+	uint32_t length = (uint32_t)(out.size() - start - 4);
+	for (int i = 0; i < 4; i++)
+		out[start + i] = (uint8_t)(length >> (i * 8));
+}
+
+void FrameStream::rowToBytes(const DisplayFrame& f, int y, uint8_t* dst) {
+	const int words = f.getRowWords();
+	for (int p = 0; p < XO_NUM_PLANES; p++) {
+		const uint64_t* row = f.getRow(p, y);
+		for (int w = 0; w < words; w++)
+			for (int b = 0; b < 8; b++)
+				*dst++ = (uint8_t)(row[w] >> (56 - b * 8));
+	}
+}
+
+void FrameStream::encodeHello(const uint32_t palette[1 << XO_NUM_PLANES], std::vector<uint8_t>& out) {
+	size_t start = beginMessage(STREAM_HELLO, out);
+	out.insert(out.end(), STREAM_MAGIC, STREAM_MAGIC + 4);
+	out.push_back((uint8_t)STREAM_VERSION);
+	for (int i = 0; i < (1 << XO_NUM_PLANES); i++)
+		putLittleEndian(out, palette[i], 4);
+	endMessage(start, out);
+}
+
+void FrameStream::encodeKeyframe(const DisplayFrame& f, std::vector<uint8_t>& out) {
+	size_t start = beginMessage(STREAM_KEYFRAME, out);
+	out.push_back(f.hiRes ? 1 : 0);
+
+	uint8_t row[XO_NUM_PLANES * CH8_ROW_WORDS * 8];
+	for (int y = 0; y < f.getHeight(); y++) {
+		rowToBytes(f, y, row);
+		out.insert(out.end(), row, row + rowBytes(f.hiRes));
+	}
+	endMessage(start, out);
+}
+
+void FrameStream::encodeKeys(uint16_t keys, std::vector<uint8_t>& out) {
+	size_t start = beginMessage(STREAM_KEYS, out);
+	putLittleEndian(out, keys, 2);
+	endMessage(start, out);
+}
+
+bool FrameStream::encodeDelta(const DisplayFrame& prev, const DisplayFrame& f, std::vector<uint8_t>& out) {
+	const size_t mark = out.size();
+	size_t start = beginMessage(STREAM_DELTA, out);
+	out.push_back(f.hiRes ? 1 : 0);
+
+	const int n = rowBytes(f.hiRes);
+	uint8_t before[XO_NUM_PLANES * CH8_ROW_WORDS * 8];
+	uint8_t diff[XO_NUM_PLANES * CH8_ROW_WORDS * 8];
+	bool any = false;
+
+	for (int y = 0; y < f.getHeight(); y++) {
+		rowToBytes(prev, y, before);
+		rowToBytes(f, y, diff);
+
+		bool changed = false;
+		for (int i = 0; i < n; i++) {
+			diff[i] ^= before[i];
+			changed |= diff[i] != 0;
+		}
+		if (!changed)
+			continue;
+		any = true;
+		out.push_back((uint8_t)y);
+
+		// Runs of zeros (unchanged bytes) and runs of anything else, up to 128 of either per token
+		int i = 0;
+		while (i < n) {
+			int run = 0;
+			while (i + run < n && run < 128 && diff[i + run] == 0)
+				++run;
+			if (run > 0) {
+				out.push_back((uint8_t)(0x80 | (run - 1)));
+				i += run;
+				continue;
+			}
+			while (i + run < n && run < 128 && diff[i + run] != 0)
+				++run;
+			out.push_back((uint8_t)(run - 1));
+			out.insert(out.end(), diff + i, diff + i + run);
+			i += run;
+		}
+	}
+
+	if (!any) {
+		out.resize(mark);
+		return false;
+	}
+	endMessage(start, out);
+	return true;
+}
+
+long FrameStream::messageSize(const uint8_t* data, size_t size) {
+	if (size < (size_t)STREAM_HEADER_SIZE)
+		return 0;
+
+	uint32_t length = getLittleEndian(data + 1, 4);
+	if (length > (uint32_t)STREAM_MAX_MESSAGE)
+		return -1;
+	if (size < STREAM_HEADER_SIZE + length)
+		return 0;
+	return STREAM_HEADER_SIZE + length;
+}
+
+bool FrameStream::readHello(const uint8_t* message, size_t size, uint32_t palette[1 << XO_NUM_PLANES]) {
+	const size_t expected = STREAM_HEADER_SIZE + 5 + 4 * (1 << XO_NUM_PLANES);
+	if (size < expected || message[0] != STREAM_HELLO || memcmp(message + STREAM_HEADER_SIZE, STREAM_MAGIC, 4) != 0
+		|| message[STREAM_HEADER_SIZE + 4] != STREAM_VERSION)
+		return false;
+
+	for (int i = 0; i < (1 << XO_NUM_PLANES); i++)
+		palette[i] = getLittleEndian(message + STREAM_HEADER_SIZE + 5 + i * 4, 4);
+	return true;
+}
+
+bool FrameStream::applyFrame(const uint8_t* message, size_t size, DisplayFrame& f) {
+	if (size < (size_t)STREAM_HEADER_SIZE + 1)
+		return false;
+
+	const int type = message[0];
+	const uint8_t* p = message + STREAM_HEADER_SIZE;
+	const uint8_t* end = message + size;
+	const bool hiRes = *p++ != 0;
+	const int n = rowBytes(hiRes);
+	const int words = hiRes ? CH8_ROW_WORDS : 1;
+	const int height = hiRes ? SCHIP_HEIGHT : CH8_HEIGHT;
+	uint8_t row[XO_NUM_PLANES * CH8_ROW_WORDS * 8];
+
+	if (type == STREAM_KEYFRAME) {
+		if (end - p != (long)n * height)
+			return false;
+		f.hiRes = hiRes;
+		f.megaMode = false;
+		f.dirty = ~0ULL;
+	}
+	else if (type != STREAM_DELTA || hiRes != f.hiRes)
+		return false;
+
+	while (p < end) {
+		int y;
+		if (type == STREAM_KEYFRAME) {
+			y = (int)((p - message - STREAM_HEADER_SIZE - 1) / n);
+			memcpy(row, p, n);
+			p += n;
+		}
+		else {
+			// Undo the run-length coding, then the XOR
+			y = *p++;
+			if (y >= height)
+				return false;
+			int i = 0;
+			while (i < n) {
+				if (p >= end)
+					return false;
+				uint8_t token = *p++;
+				int run = (token & 0x7F) + 1;
+				if (i + run > n)
+					return false;
+				if (token & 0x80)
+					memset(row + i, 0, run);
+				else {
+					if (end - p < run)
+						return false;
+					memcpy(row + i, p, run);
+					p += run;
+				}
+				i += run;
+			}
+			f.dirty |= 1ULL << y;
+		}
+
+		const uint8_t* src = row;
+		for (int plane = 0; plane < XO_NUM_PLANES; plane++) {
+			for (int w = 0; w < words; w++) {
+				uint64_t v = 0;
+				for (int b = 0; b < 8; b++)
+					v = (v << 8) | *src++;
+				uint64_t& dst = f.gfx[plane][y * words + w];
+				dst = type == STREAM_KEYFRAME ? v : dst ^ v;
+			}
+		}
+	}
+	return true;
+}
+
+#ifdef _WIN32
+// Winsock has to be started once before anything else
+static void startSockets() {
+	static bool started = false;
+	if (!started) {
+		WSADATA data;
+		WSAStartup(MAKEWORD(2, 2), &data);
+		started = true;
+	}
+}
+#endif
+
+// Split "host:port" or "port"; host is empty if there's none
+static bool parseAddress(const std::string& address, std::string& host, std::string& port) {
+	size_t colon = address.rfind(':');
+	host = colon == std::string::npos ? "" : address.substr(0, colon);
+	port = colon == std::string::npos ? address : address.substr(colon + 1);
+	return !port.empty() && atoi(port.c_str()) > 0;
+}
+
+static bool isUnixAddress(const std::string& address) {
+	return address.compare(0, 5, "unix:") == 0;
+}
+
+socket_t StreamSocket::listenOn(const std::string& address) {
+#ifdef _WIN32
+	startSockets();
+#endif
+
+	if (isUnixAddress(address)) {
+#ifdef _WIN32
+		return NO_SOCKET;
+#else
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		std::string path = address.substr(5);
+		if (path.empty() || path.size() >= sizeof(addr.sun_path))
+			return NO_SOCKET;
+		strcpy(addr.sun_path, path.c_str());
+
+		// A socket file left by a run that didn't shut down would make bind fail
+		unlink(path.c_str());
+
+		int s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s < 0)
+			return NO_SOCKET;
+		if (bind(s, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, STREAM_MAX_CLIENTS) != 0) {
+			::close(s);
+			return NO_SOCKET;
+		}
+		setNonBlocking(s);
+		return s;
+#endif
+	}
+
+	std::string host, port;
+	if (!parseAddress(address, host, port))
+		return NO_SOCKET;
+
+	// Spectating is for this machine (or an SSH tunnel to it), so only the loopback address is bound
+	sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons((uint16_t)atoi(port.c_str()));
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	socket_t s = (socket_t)socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	if (s == NO_SOCKET)
+		return NO_SOCKET;
+
+	int yes = 1;
+	setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&yes, sizeof(yes));
+	if (bind(s, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(s, STREAM_MAX_CLIENTS) != 0) {
+		close(s);
+		return NO_SOCKET;
+	}
+	setNonBlocking(s);
+	return s;
+}
+
+socket_t StreamSocket::connectTo(const std::string& address) {
+#ifdef _WIN32
+	startSockets();
+#endif
+
+	if (isUnixAddress(address)) {
+#ifdef _WIN32
+		return NO_SOCKET;
+#else
+		sockaddr_un addr;
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		std::string path = address.substr(5);
+		if (path.empty() || path.size() >= sizeof(addr.sun_path))
+			return NO_SOCKET;
+		strcpy(addr.sun_path, path.c_str());
+
+		int s = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (s < 0)
+			return NO_SOCKET;
+		if (connect(s, (sockaddr*)&addr, sizeof(addr)) != 0) {
+			::close(s);
+			return NO_SOCKET;
+		}
+		return s;
+#endif
+	}
+
+	std::string host, port;
+	if (!parseAddress(address, host, port))
+		return NO_SOCKET;
+
+	addrinfo hints;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	addrinfo* found = NULL;
+	if (getaddrinfo(host.empty() ? "127.0.0.1" : host.c_str(), port.c_str(), &hints, &found) != 0)
+		return NO_SOCKET;
+
+	socket_t s = NO_SOCKET;
+	for (addrinfo* a = found; a != NULL && s == NO_SOCKET; a = a->ai_next) {
+		s = (socket_t)socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+		if (s != NO_SOCKET && connect(s, a->ai_addr, (int)a->ai_addrlen) != 0) {
+			close(s);
+			s = NO_SOCKET;
+		}
+	}
+	freeaddrinfo(found);
+
+	// Key presses are tiny and shouldn't sit waiting for more to send with them
+	if (s != NO_SOCKET) {
+		int yes = 1;
+		setsockopt(s, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+	}
+	return s;
+}
+
+socket_t StreamSocket::acceptFrom(socket_t s) {
+	socket_t c = (socket_t)accept(s, NULL, NULL);
+	if (c == NO_SOCKET)
+		return NO_SOCKET;
+
+	setNonBlocking(c);
+
+	// Fails harmlessly on Unix sockets
+	int yes = 1;
+	setsockopt(c, IPPROTO_TCP, TCP_NODELAY, (const char*)&yes, sizeof(yes));
+	return c;
+}
+
+void StreamSocket::close(socket_t s) {
+	if (s == NO_SOCKET)
+		return;
+#ifdef _WIN32
+	closesocket(s);
+#else
+	::close(s);
+#endif
+}
+
+void StreamSocket::setNonBlocking(socket_t s) {
+#ifdef _WIN32
+	u_long on = 1;
+	ioctlsocket(s, FIONBIO, &on);
+#else
+	fcntl(s, F_SETFL, fcntl(s, F_GETFL, 0) | O_NONBLOCK);
+#endif
+}
+
+// True if the last socket call failed only because it would have had to wait
+static bool wouldBlock() {
+#ifdef _WIN32
+	return WSAGetLastError() == WSAEWOULDBLOCK;
+#else
+	return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+#endif
+}
+
+long StreamSocket::sendSome(socket_t s, const uint8_t* data, size_t size) {
+#ifdef _WIN32
+	int n = send(s, (const char*)data, (int)size, 0);
+#else
+	// A viewer that hangs up mid-write should close its connection, not raise SIGPIPE
+	ssize_t n = send(s, data, size, MSG_NOSIGNAL);
+#endif
+	if (n >= 0)
+		return (long)n;
+	return wouldBlock() ? 0 : -1;
+}
+
+long StreamSocket::receiveSome(socket_t s, uint8_t* data, size_t size) {
+#ifdef _WIN32
+	int n = recv(s, (char*)data, (int)size, 0);
+#else
+	ssize_t n = recv(s, data, size, 0);
+#endif
+	if (n > 0)
+		return (long)n;
+	if (n == 0)
+		return -1;
+	return wouldBlock() ? 0 : -1;
+}
+
+bool StreamSocket::wait(const std::vector<socket_t>& read, const std::vector<socket_t>& write, int ms,
+	std::vector<bool>& readReady, std::vector<bool>& writeReady) {
+	fd_set readSet, writeSet;
+	FD_ZERO(&readSet);
+	FD_ZERO(&writeSet);
+	int highest = -1;
+
+	for (socket_t s : read) {
+		if (s == NO_SOCKET)
+			continue;
+		FD_SET(s, &readSet);
+		highest = (int)s > highest ? (int)s : highest;
+	}
+	for (socket_t s : write) {
+		if (s == NO_SOCKET)
+			continue;
+		FD_SET(s, &writeSet);
+		highest = (int)s > highest ? (int)s : highest;
+	}
+
+	timeval timeout;
+	timeout.tv_sec = ms / 1000;
+	timeout.tv_usec = (ms % 1000) * 1000;
+
+	readReady.assign(read.size(), false);
+	writeReady.assign(write.size(), false);
+
+	// Winsock refuses to wait on nothing, so sleep through select's timeout another way there
+	if (highest < 0) {
+#ifdef _WIN32
+		Sleep(ms);
+		return true;
+#else
+		return select(0, NULL, NULL, NULL, &timeout) >= 0 || errno == EINTR;
+#endif
+	}
+
+	int ready = select(highest + 1, &readSet, &writeSet, NULL, &timeout);
+	if (ready < 0) {
+#ifndef _WIN32
+		if (errno == EINTR)
+			return true;
+#endif
+		return false;
+	}
+
+	for (size_t i = 0; i < read.size(); i++)
+		readReady[i] = read[i] != NO_SOCKET && FD_ISSET(read[i], &readSet);
+	for (size_t i = 0; i < write.size(); i++)
+		writeReady[i] = write[i] != NO_SOCKET && FD_ISSET(write[i], &writeSet);
+	return true;
+}
@@ -0,0 +1,101 @@
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "DisplayFrame.h"
+#include "constants.h"
+
+// Wire format shared by StreamServer and StreamClient
+// Every message is a type byte, a 4-byte little-endian payload length, then the payload
+enum StreamMessage {
+	STREAM_HELLO = 1,       // Server: "C8ST", version byte, the four palette colors as 4-byte little-endian ARGB
+	STREAM_KEYFRAME = 2,    // Server: mode byte (1 for 128x64), then every row
+	STREAM_DELTA = 3,       // Server: mode byte, then each changed row as its number and the run-length coded XOR
+	STREAM_KEYS = 4         // Client: the CHIP-8 keys it holds, bit n for key n, 2 bytes little-endian
+};
+
+// A row on the wire is the row's plane 0 words then its plane 1 words, each word most significant byte
+// first so bytes go left to right across the screen
+// In a delta that row is XORed with the one before and coded as tokens: a byte with the top bit set is
+// (byte & 0x7F) + 1 zero bytes, any other byte is followed by byte + 1 literal bytes
+// MegaChip frames don't fit in a few hundred bytes, so they go out as a two-color 128x64 picture
+class FrameStream {
+public:
+	// Copy a frame into f in the form it's sent
+	static void convert(const DisplayFrame& src, DisplayFrame& f);
+
+	// True if a and b would be sent the same
+	static bool sameFrame(const DisplayFrame& a, const DisplayFrame& b);
+
+	// Append a whole message to out
+	static void encodeHello(const uint32_t palette[1 << XO_NUM_PLANES], std::vector<uint8_t>& out);
+	static void encodeKeyframe(const DisplayFrame& f, std::vector<uint8_t>& out);
+	static void encodeKeys(uint16_t keys, std::vector<uint8_t>& out);
+
+	// Append the rows of f that differ from prev, which has to be in the same mode
+	// Returns false and appends nothing if no row differs
+	static bool encodeDelta(const DisplayFrame& prev, const DisplayFrame& f, std::vector<uint8_t>& out);
+
+	// Size of the message at the front of data once all of it has arrived, 0 if it hasn't yet, -1 if it's
+	// bigger than any real message could be
+	static long messageSize(const uint8_t* data, size_t size);
+
+	// Apply a keyframe or delta message to f, marking the rows it changed in f.dirty
+	// Returns false if it's malformed, leaving f as far as it got
+	static bool applyFrame(const uint8_t* message, size_t size, DisplayFrame& f);
+
+	// Read a hello message's palette, false if it isn't one
+	static bool readHello(const uint8_t* message, size_t size, uint32_t palette[1 << XO_NUM_PLANES]);
+
+private:
+	// Bytes of one row on the wire
+	static int rowBytes(bool hiRes) { return XO_NUM_PLANES * (hiRes ? CH8_ROW_WORDS : 1) * 8; }
+
+	// Row y of f laid out as it's sent
+	static void rowToBytes(const DisplayFrame& f, int y, uint8_t* dst);
+
+	// Start a message, returns where its length goes
+	static size_t beginMessage(int type, std::vector<uint8_t>& out);
+
+	// Fill in the length of the message started at start
+	static void endMessage(size_t start, std::vector<uint8_t>& out);
+};
+
+#ifdef _WIN32
+typedef uintptr_t socket_t;
+#else
+typedef int socket_t;
+#endif
+const socket_t NO_SOCKET = (socket_t)-1;
+
+// Just enough of BSD sockets and Winsock to stream over localhost TCP or a Unix socket
+// Addresses are "unix:<path>" (not on Windows), "<port>" for localhost, or "<host>:<port>" when connecting
+class StreamSocket {
+public:
+	// Listen on address, only ever on the loopback interface; returns NO_SOCKET on failure
+	static socket_t listenOn(const std::string& address);
+
+	// Connect to address, blocking until it's connected or refused
+	static socket_t connectTo(const std::string& address);
+
+	// Take a waiting connection off a listening socket, NO_SOCKET if there's none
+	static socket_t acceptFrom(socket_t s);
+
+	static void close(socket_t s);
+	static void setNonBlocking(socket_t s);
+
+	// Send or receive what can be done without waiting: bytes moved, 0 if it would have to wait,
+	// -1 if the connection is gone
+	static long sendSome(socket_t s, const uint8_t* data, size_t size);
+	static long receiveSome(socket_t s, uint8_t* data, size_t size);
+
+	// Wait up to ms for any of read to be readable or write to be writable; NO_SOCKET entries are skipped
+	// Returns false on error, the ready ones come back in readReady and writeReady
+	static bool wait(const std::vector<socket_t>& read, const std::vector<socket_t>& write, int ms,
+		std::vector<bool>& readReady, std::vector<bool>& writeReady);
+};
+
+#endif
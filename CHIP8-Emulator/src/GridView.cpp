@@ -0,0 +1,297 @@
+#include "GridView.h"
+#include <iostream>
+#include <cstring>
+#include <cmath>
+#include "Emulator.h"
+
+GridView::GridView() {
+	m_columns = 0;
+	m_rows = 0;
+	m_window = NULL;
+	m_renderer = NULL;
+	m_atlas = NULL;
+	m_atlasWidth = 0;
+	m_atlasHeight = 0;
+	m_focus = -1;
+	m_accumulator = 0;
+	m_frames = 0;
+	m_uploads = 0;
+	m_uploadedPixels = 0;
+	m_expander.setPalette(CH8_PALETTE);
+}
+
+GridView::~GridView() {
+	if (m_atlas != NULL)
+		SDL_DestroyTexture(m_atlas);
+	if (m_renderer != NULL)
+		SDL_DestroyRenderer(m_renderer);
+	if (m_window != NULL)
+		SDL_DestroyWindow(m_window);
+}
+
+int GridView::addRom(const std::string& path) {
+	if ((int)m_tiles.size() >= GRID_MAX_INSTANCES) {
+		std::cerr << "Grid is full, skipping " << path << std::endl;
+		return ERR_GRID_FULL;
+	}
+
+	Tile t;
+	t.chip.reset(new Chip8());
+	int result = t.chip->loadRom(path);
+	if (result != SUCCESS)
+		return result;
+
+	t.name = path;
+	t.hiRes = false;
+	t.megaMode = false;
+	t.x = 0;
+	t.y = 0;
+	m_tiles.push_back(std::move(t));
+	return SUCCESS;
+}
+
+void GridView::layout() {
+	const int n = (int)m_tiles.size();
+
+	// Cells are 2:1 like the window, so a square count of them keeps the window's shape
+	m_columns = (int)std::ceil(std::sqrt((double)n));
+	m_rows = (n + m_columns - 1) / m_columns;
+
+	// Every cell holds a full 128x64 screen; 64x32 ones use its top left quarter
+	m_atlasWidth = m_columns * SCHIP_WIDTH;
+	m_atlasHeight = m_rows * SCHIP_HEIGHT;
+	m_pixels.assign((size_t)m_atlasWidth * m_atlasHeight, CH8_PALETTE[0]);
+
+	for (int i = 0; i < n; i++) {
+		m_tiles[i].x = (i % m_columns) * SCHIP_WIDTH;
+		m_tiles[i].y = (i / m_columns) * SCHIP_HEIGHT;
+
+		// Force a full expand on the first frame
+		m_tiles[i].hiRes = !m_tiles[i].chip->isHiRes();
+	}
+}
+
+void GridView::stepAll(const uint8_t* ks) {
+	bool keys[16];
+	Emulator::mapKeys(ks, keys);
+	bool noKeys[16] = {};
+
+	for (int i = 0; i < (int)m_tiles.size(); i++) {
+		Chip8& chip = *m_tiles[i].chip;
+		if (chip.isHalted())
+			continue;
+
+		chip.setKeys(i == m_focus ? keys : noKeys);
+		for (int c = 0; c < CYCLES_PER_FRAME && !chip.isHalted(); c++)
+			chip.emulateCycle();
+		chip.tickTimers();
+	}
+}
+
+void GridView::expandRows(Tile& t, int first, int last) {
+	Chip8& chip = *t.chip;
+	uint32_t* cell = &m_pixels[(size_t)t.y * m_atlasWidth + t.x];
+
+	if (t.megaMode) {
+		// Sampled down to 128x64 the same way the stream and capture do it
+		const uint32_t* frame = chip.getMegaDisplay().getComposed();
+		for (int y = first; y <= last; y++) {
+			const uint32_t* src = DisplayFrame::megaSampleRow(frame, y);
+			uint32_t* dst = cell + y * m_atlasWidth;
+			for (int x = 0; x < SCHIP_WIDTH; x++)
+				dst[x] = DisplayFrame::megaSample(src, x);
+		}
+		return;
+	}
+
+	for (int y = first; y <= last; y++)
+		m_expander.expandRow(chip.getRow(0, y), chip.getRow(1, y), chip.getWidth(), cell + y * m_atlasWidth);
+}
+
+bool GridView::updateAtlas() {
+	// Union of everything expanded this frame, in atlas pixels
+	int left = m_atlasWidth, top = m_atlasHeight, right = 0, bottom = 0;
+
+	for (Tile& t : m_tiles) {
+		Chip8& chip = *t.chip;
+		uint64_t rows = chip.takeDirtyRows();
+
+		if (chip.isHiRes() != t.hiRes || chip.isMegaChip() != t.megaMode) {
+			t.hiRes = chip.isHiRes();
+			t.megaMode = chip.isMegaChip();
+			rows = ~0ULL;
+		}
+		if (!rows)
+			continue;
+
+		// MegaChip only marks rows when a whole new frame is shown, so it always goes up whole
+		int width = t.megaMode ? SCHIP_WIDTH : chip.getWidth();
+		int height = t.megaMode ? SCHIP_HEIGHT : chip.getHeight();
+
+		int first = -1, last = -1;
+		for (int y = 0; y < height; y++) {
+			if (!(rows & (1ULL << y)))
+				continue;
+			if (first < 0)
+				first = y;
+			last = y;
+		}
+		if (first < 0)
+			continue;
+
+		expandRows(t, first, last);
+
+		if (t.x < left) left = t.x;
+		if (t.y + first < top) top = t.y + first;
+		if (t.x + width > right) right = t.x + width;
+		if (t.y + last + 1 > bottom) bottom = t.y + last + 1;
+	}
+
+	if (right <= left)
+		return false;
+
+	// One lock for the whole changed area, however many tiles it spans
+	SDL_Rect area = { left, top, right - left, bottom - top };
+	void* pixels;
+	int pitch;
+	if (SDL_LockTexture(m_atlas, &area, &pixels, &pitch) == 0) {
+		for (int y = 0; y < area.h; y++)
+			memcpy((uint8_t*)pixels + y * pitch, &m_pixels[(size_t)(top + y) * m_atlasWidth + left], area.w * sizeof(uint32_t));
+		SDL_UnlockTexture(m_atlas);
+	}
+
+	++m_uploads;
+	m_uploadedPixels += (unsigned long long)area.w * area.h;
+	return true;
+}
+
+void GridView::draw() {
+	SDL_SetRenderDrawColor(m_renderer, 0x20, 0x20, 0x20, 0xFF);
+	SDL_RenderClear(m_renderer);
+
+	for (int i = 0; i < (int)m_tiles.size(); i++) {
+		const Tile& t = m_tiles[i];
+
+		// Only the part of the cell the screen uses is copied, stretched over the whole cell
+		SDL_Rect src = { t.x, t.y, SCHIP_WIDTH, SCHIP_HEIGHT };
+		if (!t.megaMode) {
+			src.w = t.chip->getWidth();
+			src.h = t.chip->getHeight();
+		}
+		SDL_Rect dst = { t.x, t.y, SCHIP_WIDTH, SCHIP_HEIGHT };
+		SDL_RenderCopy(m_renderer, m_atlas, &src, &dst);
+	}
+
+	if (m_focus >= 0) {
+		SDL_Rect outline = { m_tiles[m_focus].x, m_tiles[m_focus].y, SCHIP_WIDTH, SCHIP_HEIGHT };
+		SDL_SetRenderDrawColor(m_renderer, 0xFF, 0xC0, 0x00, 0xFF);
+		SDL_RenderDrawRect(m_renderer, &outline);
+	}
+
+	SDL_RenderPresent(m_renderer);
+	++m_frames;
+}
+
+int GridView::run() {
+	if (m_tiles.empty()) {
+		std::cerr << "No ROMs to run in the grid" << std::endl;
+		return ERR_ROM_READ;
+	}
+
+	if (!SDL_WasInit(SDL_INIT_VIDEO) && SDL_InitSubSystem(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
+		std::cerr << "Could not initialize SDL. SDL Error: " << SDL_GetError() << std::endl;
+		return ERR_INIT_SDL;
+	}
+
+	layout();
+
+	m_window = SDL_CreateWindow(
+		"CHIP-8 Grid",
+		SDL_WINDOWPOS_UNDEFINED,
+		SDL_WINDOWPOS_UNDEFINED,
+		GRID_WINDOW_WIDTH,
+		GRID_WINDOW_HEIGHT,
+		SDL_WINDOW_SHOWN |
+		SDL_WINDOW_RESIZABLE
+	);
+
+	if (m_window == NULL) {
+		std::cerr << "Could not create window. SDL Error: " << SDL_GetError() << std::endl;
+		return ERR_INIT_SDL;
+	}
+
+	m_renderer = SDL_CreateRenderer(m_window, -1, SDL_RENDERER_ACCELERATED);
+	m_atlas = SDL_CreateTexture(m_renderer,
+		SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING,
+		m_atlasWidth,
+		m_atlasHeight);
+
+	if (m_renderer == NULL || m_atlas == NULL) {
+		std::cerr << "Could not create the grid's renderer. SDL Error: " << SDL_GetError() << std::endl;
+		return ERR_INIT_SDL;
+	}
+
+	// Work in atlas pixels and let SDL scale to the window, mouse positions come back in the same units
+	SDL_RenderSetLogicalSize(m_renderer, m_atlasWidth, m_atlasHeight);
+
+	const uint8_t* keystate = SDL_GetKeyboardState(NULL);
+	const uint64_t freq = SDL_GetPerformanceFrequency();
+	uint64_t last = SDL_GetPerformanceCounter();
+	bool redraw = true;
+	bool quit = false;
+
+	while (!quit) {
+		SDL_Event e;
+		while (SDL_PollEvent(&e)) {
+			if (e.type == SDL_QUIT)
+				quit = true;
+			else if (e.type == SDL_KEYDOWN && e.key.keysym.sym == SDLK_ESCAPE)
+				quit = true;
+			else if (e.type == SDL_MOUSEBUTTONDOWN) {
+				int column = e.button.x / SCHIP_WIDTH;
+				int row = e.button.y / SCHIP_HEIGHT;
+				int i = row * m_columns + column;
+				m_focus = column >= 0 && column < m_columns && i >= 0 && i < (int)m_tiles.size() && i != m_focus ? i : -1;
+				redraw = true;
+			}
+			else if (e.type == SDL_WINDOWEVENT &&
+				(e.window.event == SDL_WINDOWEVENT_EXPOSED || e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED))
+				redraw = true;
+		}
+
+		// Same fixed step as vsync mode: run the frames that are due, never more than MAX_CATCHUP_FRAMES at once
+		uint64_t now = SDL_GetPerformanceCounter();
+		m_accumulator += (double)(now - last) / freq;
+		last = now;
+
+		int frames = 0;
+		while (m_accumulator >= TARGET_FRAMETIME_SECONDS && frames < MAX_CATCHUP_FRAMES) {
+			stepAll(keystate);
+			m_accumulator -= TARGET_FRAMETIME_SECONDS;
+			++frames;
+		}
+		if (m_accumulator >= TARGET_FRAMETIME_SECONDS)
+			m_accumulator = 0;
+
+		if (frames > 0 && updateAtlas())
+			redraw = true;
+
+		if (redraw) {
+			draw();
+			redraw = false;
+		}
+
+		// Sleep off the rest of the frame
+		double wait = (TARGET_FRAMETIME_SECONDS - m_accumulator) * 1000.0;
+		if (wait >= 1.0)
+			SDL_Delay((uint32_t)wait);
+	}
+
+	std::cout << m_tiles.size() << " tiles, " << m_frames << " frames presented, " << m_uploads << " atlas uploads";
+	if (m_uploads)
+		std::cout << ", " << m_uploadedPixels / m_uploads << " pixels each on average";
+	std::cout << std::endl;
+
+	return SUCCESS;
+}
@@ -0,0 +1,85 @@
+#ifndef GRIDVIEW_H
+#define GRIDVIEW_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <SDL.h>
+#include "Chip8.h"
+#include "PixelExpander.h"
+#include "constants.h"
+
+// Runs up to GRID_MAX_INSTANCES games side by side in one window, for attract screens
+// Every game is stepped by the same 60 Hz scheduler, and all their screens live in one texture atlas
+// The keyboard goes to whichever tile was clicked last; the grid has no sound
+class GridView {
+public:
+	GridView();
+	~GridView();
+
+	// Load a ROM into a new tile, returns the Chip8::loadRom result
+	int addRom(const std::string& path);
+
+	// Number of tiles loaded
+	int getCount() const { return (int)m_tiles.size(); }
+
+	// Open the window and run every tile until it's closed
+	int run();
+
+private:
+	struct Tile {
+		std::unique_ptr<Chip8> chip;
+		std::string name;
+
+		// Mode the tile was last expanded in, a change means every row has to be redone
+		bool hiRes;
+		bool megaMode;
+
+		// Top left corner of the tile's cell in the atlas and in the grid's logical coordinates
+		int x, y;
+	};
+
+	std::vector<Tile> m_tiles;
+
+	// Grid size in tiles
+	int m_columns, m_rows;
+
+	SDL_Window* m_window;
+	SDL_Renderer* m_renderer;
+	SDL_Texture* m_atlas;
+
+	// CPU copy of the atlas, tiles are expanded here and the changed part is copied up under one lock
+	std::vector<uint32_t> m_pixels;
+	int m_atlasWidth, m_atlasHeight;
+
+	PixelExpander m_expander;
+
+	// Tile the keyboard goes to, -1 for none
+	int m_focus;
+
+	// Game time owed but not yet run, in seconds
+	double m_accumulator;
+
+	// Frames presented, atlas locks, and pixels copied under them
+	unsigned long m_frames;
+	unsigned long m_uploads;
+	unsigned long long m_uploadedPixels;
+
+	// Lay the tiles out in a grid about as wide as it is tall and size the atlas for it
+	void layout();
+
+	// Run one 60 Hz frame on every tile that hasn't halted
+	void stepAll(const uint8_t* ks);
+
+	// Expand whatever changed on each tile and upload it, returns false if nothing did
+	bool updateAtlas();
+
+	// Expand rows [first, last] of a tile's screen into its cell of m_pixels
+	// MegaChip screens are point sampled down to the cell size
+	void expandRows(Tile& t, int first, int last);
+
+	// One SDL_RenderCopy per tile, plus an outline for the focused one
+	void draw();
+};
+
+#endif
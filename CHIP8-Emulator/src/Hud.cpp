@@ -0,0 +1,145 @@
+#include "Hud.h"
+#include <SDL_ttf.h>
+#include <iostream>
+#include <vector>
+
+Hud::Hud() {
+	m_atlas = NULL;
+	m_lineHeight = 0;
+	m_textWidth = 0;
+	m_textHeight = 0;
+}
+
+Hud::~Hud() {
+	destroy();
+}
+
+bool Hud::init(SDL_Renderer* renderer, const char* fontPath, int size) {
+	destroy();
+
+	if (!TTF_WasInit() && TTF_Init() != 0) {
+		std::cerr << "Could not initialize SDL_ttf, HUD disabled. Error: " << TTF_GetError() << std::endl;
+		return false;
+	}
+
+	TTF_Font* font = TTF_OpenFont(fontPath, size);
+	if (font == NULL) {
+		std::cerr << "Could not open HUD font " << fontPath << ", HUD disabled. Error: " << TTF_GetError() << std::endl;
+		return false;
+	}
+
+	m_lineHeight = TTF_FontLineSkip(font);
+	const SDL_Color white = { 0xFF, 0xFF, 0xFF, 0xFF };
+	const int count = HUD_LAST_GLYPH - HUD_FIRST_GLYPH + 1;
+
+	// Render each glyph once and shelf-pack them into rows of the atlas
+	std::vector<SDL_Surface*> surfaces(count, (SDL_Surface*)NULL);
+	int x = 0, y = 0, rowHeight = 0;
+	for (int i = 0; i < count; i++) {
+		uint16_t ch = (uint16_t)(HUD_FIRST_GLYPH + i);
+		int minx, maxx, miny, maxy;
+		if (TTF_GlyphMetrics(font, ch, &minx, &maxx, &miny, &maxy, &m_advance[i]) != 0)
+			m_advance[i] = 0;
+
+		surfaces[i] = TTF_RenderGlyph_Blended(font, ch, white);
+		int w = surfaces[i] ? surfaces[i]->w : 0;
+		int h = surfaces[i] ? surfaces[i]->h : 0;
+
+		if (x + w > HUD_ATLAS_WIDTH) {
+			x = 0;
+			y += rowHeight;
+			rowHeight = 0;
+		}
+		m_glyphs[i] = { x, y, w, h };
+		x += w;
+		if (h > rowHeight)
+			rowHeight = h;
+	}
+	TTF_CloseFont(font);
+
+	SDL_Surface* atlas = SDL_CreateRGBSurfaceWithFormat(0, HUD_ATLAS_WIDTH, y + rowHeight, 32, SDL_PIXELFORMAT_ARGB8888);
+	if (atlas != NULL) {
+		SDL_FillRect(atlas, NULL, 0);
+		for (int i = 0; i < count; i++) {
+			if (!surfaces[i])
+				continue;
+			// Copy the glyph's alpha as is instead of blending it onto the empty atlas
+			SDL_SetSurfaceBlendMode(surfaces[i], SDL_BLENDMODE_NONE);
+			SDL_BlitSurface(surfaces[i], NULL, atlas, &m_glyphs[i]);
+		}
+		m_atlas = SDL_CreateTextureFromSurface(renderer, atlas);
+		SDL_FreeSurface(atlas);
+	}
+
+	for (int i = 0; i < count; i++)
+		if (surfaces[i])
+			SDL_FreeSurface(surfaces[i]);
+
+	if (m_atlas == NULL) {
+		std::cerr << "Could not create HUD glyph atlas, HUD disabled. SDL Error: " << SDL_GetError() << std::endl;
+		return false;
+	}
+
+	SDL_SetTextureBlendMode(m_atlas, SDL_BLENDMODE_BLEND);
+	setText(m_text);
+	return true;
+}
+
+void Hud::destroy() {
+	if (m_atlas != NULL) {
+		SDL_DestroyTexture(m_atlas);
+		m_atlas = NULL;
+	}
+}
+
+void Hud::setText(const std::string& text) {
+	m_text = text;
+
+	// Measure once here so draw doesn't have to
+	int lineWidth = 0;
+	m_textWidth = 0;
+	m_textHeight = text.empty() ? 0 : m_lineHeight;
+	for (char c : text) {
+		if (c == '\n') {
+			lineWidth = 0;
+			m_textHeight += m_lineHeight;
+			continue;
+		}
+		if (c >= HUD_FIRST_GLYPH && c <= HUD_LAST_GLYPH)
+			lineWidth += m_advance[c - HUD_FIRST_GLYPH];
+		if (lineWidth > m_textWidth)
+			m_textWidth = lineWidth;
+	}
+}
+
+void Hud::draw(SDL_Renderer* renderer, int x, int y) const {
+	if (m_atlas == NULL || m_text.empty())
+		return;
+
+	SDL_Rect box = { x, y, m_textWidth + 2 * HUD_MARGIN, m_textHeight + 2 * HUD_MARGIN };
+	SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xA0);
+	SDL_RenderFillRect(renderer, &box);
+
+	int penX = x + HUD_MARGIN;
+	int penY = y + HUD_MARGIN;
+	for (char c : m_text) {
+		if (c == '\n') {
+			penX = x + HUD_MARGIN;
+			penY += m_lineHeight;
+			continue;
+		}
+		if (c < HUD_FIRST_GLYPH || c > HUD_LAST_GLYPH)
+			continue;
+
+		const SDL_Rect& glyph = m_glyphs[c - HUD_FIRST_GLYPH];
+		if (glyph.w > 0) {
+			SDL_Rect dst = { penX, penY, glyph.w, glyph.h };
+			SDL_RenderCopy(renderer, m_atlas, &glyph, &dst);
+		}
+		penX += m_advance[c - HUD_FIRST_GLYPH];
+	}
+
+	// Leave the draw color the way the game screen expects it
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0xFF);
+}
@@ -0,0 +1,45 @@
+#ifndef HUD_H
+#define HUD_H
+
+#include <string>
+#include <SDL.h>
+#include "constants.h"
+
+// Text overlay drawn from a glyph atlas built once from a TTF font
+// After init, drawing is one SDL_RenderCopy per character and never touches SDL_ttf
+class Hud {
+public:
+	Hud();
+	~Hud();
+
+	// Render every glyph into one texture for this renderer
+	// Returns false and stays unusable if SDL_ttf or the font can't be loaded
+	bool init(SDL_Renderer* renderer, const char* fontPath, int size);
+
+	// Free the atlas, needed before the renderer it was made for goes away
+	void destroy();
+
+	// Check if init succeeded
+	bool isReady() const { return m_atlas != NULL; }
+
+	// Text to show, lines separated by '\n'
+	void setText(const std::string& text);
+
+	// Draw the text on a translucent box with its top-left corner at x, y in window pixels
+	void draw(SDL_Renderer* renderer, int x, int y) const;
+
+private:
+	SDL_Texture* m_atlas;
+
+	// Where each glyph is in the atlas and how far it moves the pen
+	SDL_Rect m_glyphs[HUD_LAST_GLYPH - HUD_FIRST_GLYPH + 1];
+	int m_advance[HUD_LAST_GLYPH - HUD_FIRST_GLYPH + 1];
+	int m_lineHeight;
+
+	std::string m_text;
+
+	// Size of m_text in pixels, for the background box
+	int m_textWidth, m_textHeight;
+};
+
+#endif
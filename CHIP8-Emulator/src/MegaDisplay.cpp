@@ -0,0 +1,265 @@
+#include "MegaDisplay.h"
+#include <cstring>
+#include "Simd.h"
+
+// The AVX2 gather is built on any x86 compiler, whatever it was told to target, and only used if the
+// CPU turns out to have it; MSVC has no /arch switch per function, but takes AVX2 intrinsics anywhere
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MEGA_USE_AVX2
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define MEGA_TARGET_AVX2
+#else
+#define MEGA_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#ifdef MEGA_USE_AVX2
+// Whether the CPU has AVX2 and the OS saves the wider registers it uses
+static bool hasAvx2() {
+#ifdef _MSC_VER
+	int r[4];
+	__cpuid(r, 0);
+	if (r[0] < 7)
+		return false;
+
+	// OSXSAVE and AVX, then the OS has turned on saving XMM and YMM state
+	__cpuid(r, 1);
+	if (!(r[2] & (1 << 27)) || !(r[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+		return false;
+
+	__cpuidex(r, 7, 0);
+	return (r[1] & (1 << 5)) != 0;
+#else
+	// Checks the OS side too
+	__builtin_cpu_init();
+	return __builtin_cpu_supports("avx2") != 0;
+#endif
+}
+
+// Asked once, before main; MegaDisplay is only ever made once a ROM is running
+static const bool CPU_HAS_AVX2 = hasAvx2();
+
+// Widen 8 indices to 32 bits and gather their colors in one instruction, returns how many were done
+MEGA_TARGET_AVX2 static int lookupRowAvx2(const uint32_t* palette, const uint8_t* src, uint32_t* dst, int n) {
+	int i = 0;
+	for (; i + 8 <= n; i += 8) {
+		__m256i idx = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+		__m256i colors = _mm256_i32gather_epi32((const int*)palette, idx, 4);
+		_mm256_storeu_si256((__m256i*)(dst + i), colors);
+	}
+	return i;
+}
+#endif
+
+MegaDisplay::MegaDisplay() {
+	reset();
+}
+
+void MegaDisplay::reset() {
+	memset(back, 0, sizeof(back));
+
+	// Index 0 is opaque black so the background shows; the rest stay black until 02NN loads them
+	for (int i = 0; i < MEGA_PALETTE_SIZE; i++)
+		palette[i] = 0xFF000000;
+
+	for (int y = 0; y < MEGA_HEIGHT; y++)
+		for (int x = 0; x < MEGA_WIDTH; x++)
+			argb[y][x] = palette[0];
+
+	// Through the setters, so 0 means 256 here the same as it does for 03NN/04NN
+	setSpriteWidth(0);
+	setSpriteHeight(0);
+	alpha = 0xFF;
+	blendMode = MEGA_BLEND_NORMAL;
+	collisionColor = 0;
+}
+
+void MegaDisplay::present() {
+	// Composed here, once, rather than by whoever shows it, since blending twice would change it
+	compose();
+	clear();
+}
+
+void MegaDisplay::clear() {
+	memset(back, 0, sizeof(back));
+}
+
+void MegaDisplay::loadPalette(const uint8_t* src, int count) {
+	for (int i = 0; i < count && i + 1 < MEGA_PALETTE_SIZE; i++) {
+		const uint8_t* c = src + i * 4;
+		palette[i + 1] = ((uint32_t)c[0] << 24) | (c[1] << 16) | (c[2] << 8) | c[3];
+	}
+}
+
+bool MegaDisplay::drawSprite(const uint8_t* src, int x, int y, int w, int h) {
+	// Clip against the screen edges
+	int x0 = x < 0 ? 0 : x;
+	int x1 = x + w > MEGA_WIDTH ? MEGA_WIDTH : x + w;
+	int y0 = y < 0 ? 0 : y;
+	int y1 = y + h > MEGA_HEIGHT ? MEGA_HEIGHT : y + h;
+	int n = x1 - x0;
+
+	bool collision = false;
+	if (n <= 0)
+		return false;
+
+	for (int py = y0; py < y1; py++) {
+		const uint8_t* s = src + (py - y) * w + (x0 - x);
+		uint8_t* d = &back[py][x0];
+		int i = 0;
+
+#ifdef CH8_HAVE_SSE2
+		// 16 pixels at a time: transparent source pixels keep the destination, the rest replace it
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i cc = _mm_set1_epi8((char)collisionColor);
+		int hits = 0;
+
+		for (; i + 16 <= n; i += 16) {
+			__m128i sv = _mm_loadu_si128((const __m128i*)(s + i));
+			__m128i dv = _mm_loadu_si128((const __m128i*)(d + i));
+			__m128i transparent = _mm_cmpeq_epi8(sv, zero);
+
+			hits |= _mm_movemask_epi8(_mm_andnot_si128(transparent, _mm_cmpeq_epi8(dv, cc)));
+
+			dv = _mm_or_si128(_mm_and_si128(transparent, dv), _mm_andnot_si128(transparent, sv));
+			_mm_storeu_si128((__m128i*)(d + i), dv);
+		}
+
+		if (hits)
+			collision = true;
+#endif
+
+		for (; i < n; i++) {
+			if (s[i]) {
+				if (d[i] == collisionColor)
+					collision = true;
+				d[i] = s[i];
+			}
+		}
+	}
+
+	return collision;
+}
+
+void MegaDisplay::scrollDown(int n) {
+	if (n > MEGA_HEIGHT)
+		n = MEGA_HEIGHT;
+	memmove(back[n], back[0], (MEGA_HEIGHT - n) * sizeof(back[0]));
+	memset(back[0], 0, n * sizeof(back[0]));
+}
+
+void MegaDisplay::scrollUp(int n) {
+	if (n > MEGA_HEIGHT)
+		n = MEGA_HEIGHT;
+	memmove(back[0], back[n], (MEGA_HEIGHT - n) * sizeof(back[0]));
+	memset(back[MEGA_HEIGHT - n], 0, n * sizeof(back[0]));
+}
+
+void MegaDisplay::scrollRight(int n) {
+	for (int y = 0; y < MEGA_HEIGHT; y++) {
+		memmove(&back[y][n], &back[y][0], MEGA_WIDTH - n);
+		memset(&back[y][0], 0, n);
+	}
+}
+
+void MegaDisplay::scrollLeft(int n) {
+	for (int y = 0; y < MEGA_HEIGHT; y++) {
+		memmove(&back[y][0], &back[y][n], MEGA_WIDTH - n);
+		memset(&back[y][MEGA_WIDTH - n], 0, n);
+	}
+}
+
+void MegaDisplay::compose() {
+	// Plain replace can convert straight into the output
+	bool direct = blendMode == MEGA_BLEND_NORMAL && alpha == 0xFF;
+	uint32_t row[MEGA_WIDTH];
+
+	for (int y = 0; y < MEGA_HEIGHT; y++) {
+		if (direct)
+			lookupRow(back[y], argb[y], MEGA_WIDTH);
+		else {
+			lookupRow(back[y], row, MEGA_WIDTH);
+			blendRow(row, argb[y], MEGA_WIDTH);
+		}
+	}
+}
+
+void MegaDisplay::lookupRow(const uint8_t* src, uint32_t* dst, int n) const {
+	int i = 0;
+
+#ifdef MEGA_USE_AVX2
+	if (CPU_HAS_AVX2)
+		i = lookupRowAvx2(palette, src, dst, n);
+#endif
+
+	// No gather before AVX2, so unroll to keep the loads independent
+	for (; i + 4 <= n; i += 4) {
+		dst[i] = palette[src[i]];
+		dst[i + 1] = palette[src[i + 1]];
+		dst[i + 2] = palette[src[i + 2]];
+		dst[i + 3] = palette[src[i + 3]];
+	}
+	for (; i < n; i++)
+		dst[i] = palette[src[i]];
+}
+
+void MegaDisplay::blendRow(const uint32_t* src, uint32_t* dst, int n) const {
+	// Weight of the new frame out of 128 for the alpha modes, so (s - d) * weight fits in 16 bits
+	int weight;
+	switch (blendMode) {
+	case MEGA_BLEND_25: weight = 32; break;
+	case MEGA_BLEND_50: weight = 64; break;
+	case MEGA_BLEND_75: weight = 96; break;
+	default: weight = (alpha + 1) >> 1; break;
+	}
+
+	int i = 0;
+
+#ifdef CH8_HAVE_SSE2
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i w16 = _mm_set1_epi16((short)weight);
+
+	// 4 pixels per iteration, channels widened to 16 bits where the math needs headroom
+	for (; i + 4 <= n; i += 4) {
+		__m128i s = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i d = _mm_loadu_si128((const __m128i*)(dst + i));
+		__m128i out;
+
+		if (blendMode == MEGA_BLEND_ADD)
+			out = _mm_adds_epu8(s, d);
+		else {
+			__m128i sLo = _mm_unpacklo_epi8(s, zero), sHi = _mm_unpackhi_epi8(s, zero);
+			__m128i dLo = _mm_unpacklo_epi8(d, zero), dHi = _mm_unpackhi_epi8(d, zero);
+
+			if (blendMode == MEGA_BLEND_MULTIPLY) {
+				sLo = _mm_srli_epi16(_mm_mullo_epi16(sLo, dLo), 8);
+				sHi = _mm_srli_epi16(_mm_mullo_epi16(sHi, dHi), 8);
+			}
+			else {
+				// d + (s - d) * w / 128
+				sLo = _mm_add_epi16(dLo, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(sLo, dLo), w16), 7));
+				sHi = _mm_add_epi16(dHi, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(sHi, dHi), w16), 7));
+			}
+			out = _mm_packus_epi16(sLo, sHi);
+		}
+
+		_mm_storeu_si128((__m128i*)(dst + i), out);
+	}
+#endif
+
+	for (; i < n; i++) {
+		uint32_t s = src[i], d = dst[i], out = 0;
+		for (int shift = 0; shift < 32; shift += 8) {
+			int sc = (s >> shift) & 0xFF, dc = (d >> shift) & 0xFF, c;
+			if (blendMode == MEGA_BLEND_ADD)
+				c = sc + dc > 0xFF ? 0xFF : sc + dc;
+			else if (blendMode == MEGA_BLEND_MULTIPLY)
+				c = (sc * dc) >> 8;
+			else c = dc + (((sc - dc) * weight) >> 7);
+			out |= (uint32_t)c << shift;
+		}
+		dst[i] = out;
+	}
+}
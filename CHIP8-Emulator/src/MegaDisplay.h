@@ -0,0 +1,84 @@
+#ifndef MEGADISPLAY_H
+#define MEGADISPLAY_H
+
+#include <cstdint>
+#include "constants.h"
+
+// How a finished MegaChip frame is combined with the one already on screen
+enum MegaBlendMode {
+	MEGA_BLEND_NORMAL = 0,     // Replace, weighted by the screen alpha set with 05NN
+	MEGA_BLEND_25 = 1,         // 25% new frame
+	MEGA_BLEND_50 = 2,         // 50% new frame
+	MEGA_BLEND_75 = 3,         // 75% new frame
+	MEGA_BLEND_ADD = 4,        // Saturating add
+	MEGA_BLEND_MULTIPLY = 5    // Multiply
+};
+
+// 256x192 8-bit indexed display used while a ROM is in MegaChip mode
+class MegaDisplay {
+public:
+	MegaDisplay();
+
+	// Reset the palette, sprite size, blend state and both buffers
+	void reset();
+
+	// 00E0: compose what has been drawn so far, so every reader of getComposed sees the same frame
+	// from then on, and start a new one
+	void present();
+
+	// Clear the frame being drawn
+	void clear();
+
+	// 02NN: load count ARGB colors starting at palette index 1
+	void loadPalette(const uint8_t* src, int count);
+
+	// 03NN/04NN: set the size DXYN draws at, 0 means 256
+	void setSpriteWidth(int w) { spriteWidth = w ? w : 256; }
+	void setSpriteHeight(int h) { spriteHeight = h ? h : 256; }
+	int getSpriteWidth() const { return spriteWidth; }
+	int getSpriteHeight() const { return spriteHeight; }
+
+	// 05NN, 080N, 09NN
+	void setAlpha(uint8_t a) { alpha = a; }
+	void setBlendMode(int mode) { blendMode = mode <= MEGA_BLEND_MULTIPLY ? mode : MEGA_BLEND_NORMAL; }
+	void setCollisionColor(uint8_t index) { collisionColor = index; }
+
+	// Draw a sprite of one index per byte; index 0 is transparent, sprites clip at the edges
+	// Returns true if any pixel it covered had the collision color
+	bool drawSprite(const uint8_t* src, int x, int y, int w, int h);
+
+	// Scroll the frame being drawn, n in pixels
+	void scrollDown(int n);
+	void scrollUp(int n);
+	void scrollRight(int n);
+	void scrollLeft(int n);
+
+	// The last presented frame as ARGB8888, MEGA_WIDTH * MEGA_HEIGHT pixels row by row
+	const uint32_t* getComposed() const { return &argb[0][0]; }
+
+private:
+	// Frame being drawn, as palette indices
+	uint8_t back[MEGA_HEIGHT][MEGA_WIDTH];
+
+	// Last presented frame, kept so blend modes have something to blend with
+	uint32_t argb[MEGA_HEIGHT][MEGA_WIDTH];
+
+	// Colors as 0xAARRGGBB, index 0 is the background
+	uint32_t palette[MEGA_PALETTE_SIZE];
+
+	int spriteWidth, spriteHeight;
+	uint8_t alpha;
+	int blendMode;
+	uint8_t collisionColor;
+
+	// Convert the frame being drawn to ARGB8888 through the palette and blend it over the last one
+	void compose();
+
+	// Look up n indices in the palette
+	void lookupRow(const uint8_t* src, uint32_t* dst, int n) const;
+
+	// Combine a freshly converted row into the composed row
+	void blendRow(const uint32_t* src, uint32_t* dst, int n) const;
+};
+
+#endif
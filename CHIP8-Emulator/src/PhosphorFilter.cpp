@@ -0,0 +1,137 @@
+#include "PhosphorFilter.h"
+#include <cstring>
+#include "Simd.h"
+
+PhosphorFilter::PhosphorFilter() {
+	m_count = 0;
+	m_width = 0;
+	m_height = 0;
+	m_newest = 0;
+	m_primed = false;
+	m_sameFrames = 0;
+}
+
+void PhosphorFilter::setWeights(const int* weights, int count) {
+	if (count > PHOSPHOR_MAX_FRAMES)
+		count = PHOSPHOR_MAX_FRAMES;
+
+	int total = 0;
+	for (int i = 0; i < count; i++)
+		total += weights[i] > 0 ? weights[i] : 0;
+
+	if (total == 0) {
+		m_count = 0;
+		return;
+	}
+
+	// Scale to 256 in all, rounding left over goes to the newest frame so full white stays full white
+	int sum = 0;
+	for (int i = 0; i < count; i++) {
+		m_weights[i] = (uint16_t)((weights[i] > 0 ? weights[i] : 0) * 256 / total);
+		sum += m_weights[i];
+	}
+	m_weights[0] += 256 - sum;
+
+	m_count = count;
+	reset(m_width, m_height);
+}
+
+void PhosphorFilter::reset(int width, int height) {
+	m_width = width;
+	m_height = height;
+	m_history.assign((size_t)PHOSPHOR_MAX_FRAMES * width * height, 0);
+	m_rowAge.assign(height, 0);
+	m_newest = 0;
+	m_primed = false;
+	m_sameFrames = 0;
+}
+
+const uint32_t* PhosphorFilter::frame(int age) const {
+	int slot = (m_newest - age + m_count) % m_count;
+	return &m_history[(size_t)slot * m_width * m_height];
+}
+
+void PhosphorFilter::push(const uint32_t* src, int pitch) {
+	if (!m_count)
+		return;
+
+	const size_t rowBytes = m_width * sizeof(uint32_t);
+
+	// Nothing to fade in from yet, so the first frame fills the whole history
+	if (!m_primed) {
+		for (int s = 0; s < m_count; s++)
+			for (int y = 0; y < m_height; y++)
+				memcpy(&m_history[((size_t)s * m_height + y) * m_width], src + y * pitch, rowBytes);
+		m_primed = true;
+		m_sameFrames = m_count;
+		m_rowAge.assign(m_height, (uint8_t)m_count);
+		return;
+	}
+
+	const uint32_t* prev = frame(0);
+	m_newest = (m_newest + 1) % m_count;
+	uint32_t* dst = &m_history[(size_t)m_newest * m_width * m_height];
+
+	bool same = true;
+	for (int y = 0; y < m_height; y++) {
+		const uint32_t* row = src + y * pitch;
+		if (memcmp(row, prev + y * m_width, rowBytes) != 0) {
+			same = false;
+			m_rowAge[y] = 0;
+		}
+		else if (m_rowAge[y] < m_count)
+			++m_rowAge[y];
+		memcpy(dst + y * m_width, row, rowBytes);
+	}
+
+	m_sameFrames = same ? m_sameFrames + 1 : 0;
+}
+
+void PhosphorFilter::blend(uint32_t* dst, int pitch) const {
+	if (!m_count)
+		return;
+
+	const uint32_t* frames[PHOSPHOR_MAX_FRAMES];
+	for (int k = 0; k < m_count; k++)
+		frames[k] = frame(k);
+
+	for (int y = 0; y < m_height; y++) {
+		const int offset = y * m_width;
+		uint32_t* out = dst + y * pitch;
+		int x = 0;
+
+		// Every frame has the same row, and the weights add up to 1, so the mix is just that row
+		if (m_rowAge[y] >= m_count - 1) {
+			memcpy(out, frames[0] + offset, m_width * sizeof(uint32_t));
+			continue;
+		}
+
+#ifdef CH8_HAVE_SSE2
+		// 4 pixels at a time, channels widened to 16 bits; weights add to 256 so the sum can't pass 0xFF00
+		const __m128i zero = _mm_setzero_si128();
+		for (; x + 4 <= m_width; x += 4) {
+			__m128i lo = _mm_setzero_si128();
+			__m128i hi = _mm_setzero_si128();
+			for (int k = 0; k < m_count; k++) {
+				__m128i w = _mm_set1_epi16((short)m_weights[k]);
+				__m128i s = _mm_loadu_si128((const __m128i*)(frames[k] + offset + x));
+				lo = _mm_add_epi16(lo, _mm_mullo_epi16(_mm_unpacklo_epi8(s, zero), w));
+				hi = _mm_add_epi16(hi, _mm_mullo_epi16(_mm_unpackhi_epi8(s, zero), w));
+			}
+			__m128i result = _mm_packus_epi16(_mm_srli_epi16(lo, 8), _mm_srli_epi16(hi, 8));
+			_mm_storeu_si128((__m128i*)(out + x), result);
+		}
+#endif
+
+		for (; x < m_width; x++) {
+			uint32_t pixel = 0;
+			for (int shift = 0; shift < 32; shift += 8) {
+				uint32_t c = 0;
+				for (int k = 0; k < m_count; k++)
+					c += ((frames[k][offset + x] >> shift) & 0xFF) * m_weights[k];
+				pixel |= (c >> 8) << shift;
+			}
+			out[x] = pixel;
+		}
+	}
+}
@@ -0,0 +1,56 @@
+#ifndef PHOSPHORFILTER_H
+#define PHOSPHORFILTER_H
+
+#include <cstdint>
+#include <vector>
+#include "constants.h"
+
+// Fakes CRT phosphor persistence by showing a weighted mix of the last few frames
+// XOR-drawn sprites that get erased and redrawn every frame stop flickering and fade instead
+class PhosphorFilter {
+public:
+	PhosphorFilter();
+
+	// Weight of each frame, newest first, up to PHOSPHOR_MAX_FRAMES of them; 0 frames turns the filter off
+	// Only the ratios matter, they're scaled to add up to 256
+	void setWeights(const int* weights, int count);
+
+	// Check if setWeights turned it on
+	bool isEnabled() const { return m_count > 0; }
+
+	// Forget the history and start over at a new size in pixels
+	void reset(int width, int height);
+
+	// Add a frame of ARGB8888 pixels, pitch in pixels; the oldest one drops out
+	void push(const uint32_t* src, int pitch);
+
+	// Check if older frames still differ from the newest, meaning the output will keep changing
+	bool isSettling() const { return m_count > 0 && m_sameFrames < m_count - 1; }
+
+	// Write the weighted mix of the history to dst, pitch in pixels
+	void blend(uint32_t* dst, int pitch) const;
+
+private:
+	// Weight of each frame out of 256, newest first
+	uint16_t m_weights[PHOSPHOR_MAX_FRAMES];
+	int m_count;
+
+	int m_width, m_height;
+
+	// Frames back to back, m_newest is the slot written last
+	std::vector<uint32_t> m_history;
+	int m_newest;
+
+	// Set once the first frame after a reset has filled every slot
+	bool m_primed;
+
+	// How many frames in a row were pushed unchanged
+	int m_sameFrames;
+
+	// Same, per row; rows unchanged for the whole history are copied instead of mixed
+	std::vector<uint8_t> m_rowAge;
+
+	const uint32_t* frame(int age) const;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "PixelExpander.h"
+#include <cstring>
+#include "Chip8.h"
+#include "Simd.h"
+
+PixelExpander::PixelExpander() {
+	setPalette(CH8_PALETTE);
+}
+
+void PixelExpander::setPalette(const uint32_t palette[1 << XO_NUM_PLANES]) {
+	for (int bits = 0; bits < 256; bits++) {
+		int p0 = bits & 0xF;
+		int p1 = bits >> 4;
+
+		// Most significant bit of the nibble is the leftmost pixel
+		for (int i = 0; i < 4; i++) {
+			int shift = 3 - i;
+			int index = ((p0 >> shift) & 1) | (((p1 >> shift) & 1) << 1);
+			m_table[bits][i] = palette[index];
+		}
+	}
+}
+
+void PixelExpander::expandRow(const uint64_t* plane0, const uint64_t* plane1, int width, uint32_t* dst) const {
+	for (int w = 0; w < width / 64; w++) {
+		uint64_t a = plane0[w];
+		uint64_t b = plane1[w];
+
+		// Take a nibble from each plane, 4 pixels per table entry
+		for (int shift = 60; shift >= 0; shift -= 4) {
+			int key = ((a >> shift) & 0xF) | (((b >> shift) & 0xF) << 4);
+
+#ifdef CH8_HAVE_SSE2
+			_mm_storeu_si128((__m128i*)dst, _mm_load_si128((const __m128i*)m_table[key]));
+#else
+			memcpy(dst, m_table[key], sizeof(m_table[key]));
+#endif
+			dst += 4;
+		}
+	}
+}
+
+void PixelExpander::expand(const Chip8& chip, uint32_t* dst, int pitch) const {
+	const int width = chip.getWidth();
+	const int height = chip.getHeight();
+
+	for (int y = 0; y < height; y++)
+		expandRow(chip.getRow(0, y), chip.getRow(1, y), width, dst + y * pitch);
+}
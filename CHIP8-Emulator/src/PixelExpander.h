@@ -0,0 +1,29 @@
+#ifndef PIXELEXPANDER_H
+#define PIXELEXPANDER_H
+
+#include <cstdint>
+#include "constants.h"
+
+class Chip8;
+
+// Turns the packed bitplane display into ARGB8888 pixels
+class PixelExpander {
+public:
+	PixelExpander();
+
+	// Set the color for each combination of plane bits and rebuild the lookup table
+	void setPalette(const uint32_t palette[1 << XO_NUM_PLANES]);
+
+	// Expand width pixels of one row from both planes into dst
+	void expandRow(const uint64_t* plane0, const uint64_t* plane1, int width, uint32_t* dst) const;
+
+	// Expand the whole display in its current mode, pitch is in pixels
+	void expand(const Chip8& chip, uint32_t* dst, int pitch) const;
+
+private:
+	// Four finished pixels for every pair of 4-bit plane nibbles, indexed by (plane1 << 4) | plane0
+	// Lets a row be written 16 bytes at a time
+	alignas(16) uint32_t m_table[256][4];
+};
+
+#endif
@@ -0,0 +1,166 @@
+#include "PixelScaler.h"
+#include <cstring>
+#include "DisplayFrame.h"
+
+// One 64-pixel word of every plane, so colors compare and select as a unit
+struct PlaneWords {
+	uint64_t p[XO_NUM_PLANES];
+};
+
+// Bit set where a and b are the same color
+static inline uint64_t same(const PlaneWords& a, const PlaneWords& b) {
+	uint64_t diff = 0;
+	for (int i = 0; i < XO_NUM_PLANES; i++)
+		diff |= a.p[i] ^ b.p[i];
+	return ~diff;
+}
+
+// a where the mask is set, e elsewhere
+static inline PlaneWords pick(uint64_t mask, const PlaneWords& a, const PlaneWords& e) {
+	PlaneWords out;
+	for (int i = 0; i < XO_NUM_PLANES; i++)
+		out.p[i] = (a.p[i] & mask) | (e.p[i] & ~mask);
+	return out;
+}
+
+PixelScaler::PixelScaler() {
+	for (int b = 0; b < 256; b++) {
+		m_spread2[b] = 0;
+		m_spread3[b] = 0;
+		for (int k = 0; k < 8; k++) {
+			if ((b >> k) & 1) {
+				m_spread2[b] |= 1 << (2 * k);
+				m_spread3[b] |= 1 << (3 * k);
+			}
+		}
+	}
+
+	memset(m_out, 0, sizeof(m_out));
+	setFilter(SCALE_NONE);
+}
+
+void PixelScaler::setFilter(int filter) {
+	m_filter = filter >= 0 && filter < SCALE_FILTER_COUNT ? filter : SCALE_NONE;
+
+	switch (m_filter) {
+	case SCALE_2X:
+	case SCALE_EPX: m_factor = 2; break;
+	case SCALE_3X: m_factor = 3; break;
+	default: m_factor = 1; break;
+	}
+}
+
+const char* PixelScaler::filterName(int filter) {
+	switch (filter) {
+	case SCALE_2X: return "Scale2x";
+	case SCALE_3X: return "Scale3x";
+	case SCALE_EPX: return "EPX";
+	default: return "none";
+	}
+}
+
+void PixelScaler::scaleRows(const DisplayFrame& f, int first, int last) {
+	if (m_factor == 1 || f.megaMode)
+		return;
+
+	const int words = f.getRowWords();
+	for (int y = first; y <= last; y++)
+		for (int w = 0; w < words; w++)
+			scaleWord(f, y, w);
+}
+
+void PixelScaler::scaleWord(const DisplayFrame& f, int y, int w) {
+	const int height = f.getHeight();
+	const int words = f.getRowWords();
+
+	// Edges repeat the border pixels, as the reference filters do
+	int up = y > 0 ? y - 1 : y;
+	int down = y + 1 < height ? y + 1 : y;
+
+	// Name the 3x3 neighborhood like the Scale3x description:
+	// A B C
+	// D E F
+	// G H I
+	PlaneWords A, B, C, D, E, F, G, H, I;
+	for (int p = 0; p < XO_NUM_PLANES; p++) {
+		const int rows[3] = { up, y, down };
+		uint64_t left[3], mid[3], right[3];
+
+		// Shifting a row by one lines every pixel up with its neighbor; bit 63 is the leftmost pixel
+		for (int r = 0; r < 3; r++) {
+			const uint64_t* row = f.getRow(p, rows[r]);
+			mid[r] = row[w];
+			left[r] = (row[w] >> 1) | (w > 0 ? row[w - 1] << 63 : row[w] & (1ULL << 63));
+			right[r] = (row[w] << 1) | (w + 1 < words ? row[w + 1] >> 63 : row[w] & 1);
+		}
+
+		A.p[p] = left[0]; B.p[p] = mid[0]; C.p[p] = right[0];
+		D.p[p] = left[1]; E.p[p] = mid[1]; F.p[p] = right[1];
+		G.p[p] = left[2]; H.p[p] = mid[2]; I.p[p] = right[2];
+	}
+
+	uint64_t db = same(D, B), bf = same(B, F), dh = same(D, H), hf = same(H, F);
+
+	// Corner rules, shared by Scale2x and Scale3x
+	uint64_t topLeft = db & ~bf & ~dh;
+	uint64_t topRight = bf & ~db & ~hf;
+	uint64_t bottomLeft = dh & ~db & ~hf;
+	uint64_t bottomRight = hf & ~dh & ~bf;
+
+	PlaneWords sub[SCALE_MAX_FACTOR * SCALE_MAX_FACTOR];
+	if (m_factor == 2) {
+		sub[0] = pick(topLeft, D, E);
+		sub[1] = pick(topRight, F, E);
+		sub[2] = pick(bottomLeft, D, E);
+		sub[3] = pick(bottomRight, F, E);
+	}
+	else {
+		uint64_t ea = same(E, A), ec = same(E, C), eg = same(E, G), ei = same(E, I);
+		sub[0] = pick(topLeft, D, E);
+		sub[1] = pick((topLeft & ~ec) | (topRight & ~ea), B, E);
+		sub[2] = pick(topRight, F, E);
+		sub[3] = pick((topLeft & ~eg) | (bottomLeft & ~ea), D, E);
+		sub[4] = E;
+		sub[5] = pick((topRight & ~ei) | (bottomRight & ~ec), F, E);
+		sub[6] = pick(bottomLeft, D, E);
+		sub[7] = pick((bottomLeft & ~ei) | (bottomRight & ~eg), H, E);
+		sub[8] = pick(bottomRight, F, E);
+	}
+
+	for (int p = 0; p < XO_NUM_PLANES; p++) {
+		for (int r = 0; r < m_factor; r++) {
+			uint64_t words[SCALE_MAX_FACTOR];
+			for (int c = 0; c < m_factor; c++)
+				words[c] = sub[r * m_factor + c].p[p];
+			interleave(words, &m_out[p][y * m_factor + r][w * m_factor]);
+		}
+	}
+}
+
+void PixelScaler::interleave(const uint64_t* sub, uint64_t* dst) const {
+	const int bits = 8 * m_factor;
+	for (int i = 0; i < m_factor; i++)
+		dst[i] = 0;
+
+	// A byte at a time: 8 source pixels become 8 * m_factor output bits
+	for (int j = 0; j < 8; j++) {
+		int shift = 56 - 8 * j;
+		uint64_t v = 0;
+		for (int c = 0; c < m_factor; c++) {
+			int b = (sub[c] >> shift) & 0xFF;
+			v |= (uint64_t)(m_factor == 2 ? m_spread2[b] : m_spread3[b]) << (m_factor - 1 - c);
+		}
+
+		// Place it counting from the most significant bit of dst[0]; 3x groups can straddle two words
+		int pos = bits * j;
+		int word = pos >> 6;
+		int off = pos & 63;
+		if (off + bits <= 64)
+			dst[word] |= v << (64 - off - bits);
+		else {
+			int spill = off + bits - 64;
+			dst[word] |= v >> spill;
+			dst[word + 1] |= v << (64 - spill);
+		}
+	}
+}
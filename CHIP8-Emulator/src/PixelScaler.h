@@ -0,0 +1,59 @@
+#ifndef PIXELSCALER_H
+#define PIXELSCALER_H
+
+#include <cstdint>
+#include "constants.h"
+
+struct DisplayFrame;
+
+// Pixel-art upscaling filters the presenter can run before expanding to ARGB
+enum ScaleFilter {
+	SCALE_NONE = 0,     // Leave it to the renderer's nearest-neighbor scaling
+	SCALE_2X = 1,       // Scale2x (AdvMAME2x)
+	SCALE_3X = 2,       // Scale3x (AdvMAME3x)
+	SCALE_EPX = 3,      // EPX, which gives the same pixels as Scale2x
+	SCALE_FILTER_COUNT = 4
+};
+
+// Runs Scale2x/Scale3x/EPX on the packed bitplane display, 64 pixels per operation
+// The result stays packed, one plane per XO-CHIP plane, so PixelExpander can color it like the original
+class PixelScaler {
+public:
+	PixelScaler();
+
+	// Pick the filter, ScaleFilter values
+	void setFilter(int filter);
+	int getFilter() const { return m_filter; }
+
+	// How many times wider and taller the output is than the input
+	int getFactor() const { return m_factor; }
+
+	// Rescale source rows [first, last] of f into the output, other rows keep what they had
+	// Each output row depends on the rows above and below it too, so callers pass those in when they change
+	void scaleRows(const DisplayFrame& f, int first, int last);
+
+	// Row y of an output plane, getFactor() times as many pixels as a source row
+	const uint64_t* getRow(int plane, int y) const { return m_out[plane][y]; }
+
+	// Name of a filter for messages
+	static const char* filterName(int filter);
+
+private:
+	int m_filter;
+	int m_factor;
+
+	// Scaled planes, rows SCALE_ROW_WORDS apart whatever the mode
+	uint64_t m_out[XO_NUM_PLANES][SCHIP_HEIGHT * SCALE_MAX_FACTOR][SCALE_ROW_WORDS];
+
+	// Bit k of a byte moved to bit 2k and 3k, for interleaving subpixels back into rows
+	uint16_t m_spread2[256];
+	uint32_t m_spread3[256];
+
+	// Scale word w of source row y, writing m_factor output rows
+	void scaleWord(const DisplayFrame& f, int y, int w);
+
+	// Interleave m_factor subpixel words into output words starting at dst, leftmost subpixel first
+	void interleave(const uint64_t* sub, uint64_t* dst) const;
+};
+
+#endif
@@ -0,0 +1,227 @@
+#include "PngEncoder.h"
+#include <fstream>
+
+// Deflate's length and distance codes: smallest value of each and how many extra bits follow it
+static const uint16_t LENGTH_BASE[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const uint8_t LENGTH_EXTRA[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const uint16_t DISTANCE_BASE[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577
+};
+static const uint8_t DISTANCE_EXTRA[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const int DEFLATE_MIN_MATCH = 3;
+static const int DEFLATE_MAX_MATCH = 258;
+static const size_t DEFLATE_WINDOW = 32768;
+
+// Packs bits least significant first, the way deflate streams are laid out
+struct BitWriter {
+	std::vector<uint8_t>& out;
+	uint32_t buffer;
+	int count;
+
+	BitWriter(std::vector<uint8_t>& o) : out(o), buffer(0), count(0) {}
+
+	void bits(uint32_t value, int n) {
+		buffer |= value << count;
+		count += n;
+		while (count >= 8) {
+			out.push_back((uint8_t)buffer);
+			buffer >>= 8;
+			count -= 8;
+		}
+	}
+
+	// Huffman codes are defined most significant bit first, so they go in reversed
+	void code(uint32_t value, int n) {
+		uint32_t reversed = 0;
+		for (int i = 0; i < n; i++)
+			reversed |= ((value >> i) & 1) << (n - 1 - i);
+		bits(reversed, n);
+	}
+
+	// Fixed Huffman code of a literal/length symbol
+	void symbol(int s) {
+		if (s < 144)
+			code(0x30 + s, 8);
+		else if (s < 256)
+			code(0x190 + s - 144, 9);
+		else if (s < 280)
+			code(s - 256, 7);
+		else code(0xC0 + s - 280, 8);
+	}
+
+	void match(int length, int distance) {
+		int l = 28;
+		while (LENGTH_BASE[l] > length)
+			--l;
+		symbol(257 + l);
+		bits(length - LENGTH_BASE[l], LENGTH_EXTRA[l]);
+
+		int d = 29;
+		while (DISTANCE_BASE[d] > distance)
+			--d;
+		code(d, 5);
+		bits(distance - DISTANCE_BASE[d], DISTANCE_EXTRA[d]);
+	}
+
+	void flush() {
+		if (count > 0)
+			out.push_back((uint8_t)buffer);
+		buffer = 0;
+		count = 0;
+	}
+};
+
+static void putBigEndian(std::vector<uint8_t>& out, uint32_t v) {
+	out.push_back((uint8_t)(v >> 24));
+	out.push_back((uint8_t)(v >> 16));
+	out.push_back((uint8_t)(v >> 8));
+	out.push_back((uint8_t)v);
+}
+
+// Table for the byte-at-a-time CRC-32, built on first use
+struct CrcTable {
+	uint32_t entries[256];
+
+	CrcTable() {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint32_t c = n;
+			for (int k = 0; k < 8; k++)
+				c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+			entries[n] = c;
+		}
+	}
+};
+
+uint32_t PngEncoder::crc32(const uint8_t* data, size_t size, uint32_t crc) {
+	static const CrcTable table;
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; i++)
+		crc = table.entries[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+uint32_t PngEncoder::adler32(const uint8_t* data, size_t size, uint32_t adler) {
+	uint32_t a = adler & 0xFFFF;
+	uint32_t b = adler >> 16;
+
+	// 5552 bytes is the most that can be summed before the 32-bit totals could overflow
+	while (size > 0) {
+		size_t n = size < 5552 ? size : 5552;
+		size -= n;
+		while (n--) {
+			a += *data++;
+			b += a;
+		}
+		a %= 65521;
+		b %= 65521;
+	}
+	return (b << 16) | a;
+}
+
+void PngEncoder::deflate(const std::vector<uint8_t>& data, size_t rowBytes, std::vector<uint8_t>& out) {
+	BitWriter w(out);
+
+	// One final block with the fixed codes, no code tables to build or send
+	w.bits(1, 1);
+	w.bits(1, 2);
+
+	const size_t distances[3] = { 1, 3, rowBytes };
+	const size_t size = data.size();
+	size_t pos = 0;
+
+	while (pos < size) {
+		size_t bestLength = 0, bestDistance = 0;
+		size_t longest = size - pos < DEFLATE_MAX_MATCH ? size - pos : DEFLATE_MAX_MATCH;
+
+		for (size_t d : distances) {
+			if (d > pos || d > DEFLATE_WINDOW)
+				continue;
+			size_t length = 0;
+			while (length < longest && data[pos + length] == data[pos + length - d])
+				++length;
+			if (length > bestLength) {
+				bestLength = length;
+				bestDistance = d;
+			}
+		}
+
+		if (bestLength >= DEFLATE_MIN_MATCH) {
+			w.match((int)bestLength, (int)bestDistance);
+			pos += bestLength;
+		}
+		else w.symbol(data[pos++]);
+	}
+
+	// End of block
+	w.symbol(256);
+	w.flush();
+}
+
+void PngEncoder::chunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size) {
+	putBigEndian(out, (uint32_t)size);
+	size_t start = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data, data + size);
+	putBigEndian(out, crc32(&out[start], size + 4));
+}
+
+void PngEncoder::encode(const uint32_t* pixels, int width, int height, int pitch, std::vector<uint8_t>& out) {
+	// Each row is a filter byte (0, none) and then RGB
+	const size_t rowBytes = 1 + (size_t)width * 3;
+	std::vector<uint8_t> raw(rowBytes * height);
+	for (int y = 0; y < height; y++) {
+		uint8_t* row = &raw[y * rowBytes];
+		const uint32_t* src = pixels + (size_t)y * pitch;
+		*row++ = 0;
+		for (int x = 0; x < width; x++) {
+			*row++ = (uint8_t)(src[x] >> 16);
+			*row++ = (uint8_t)(src[x] >> 8);
+			*row++ = (uint8_t)src[x];
+		}
+	}
+
+	// zlib wrapper around the deflate stream: header, data, Adler-32 of the raw bytes
+	std::vector<uint8_t> idat;
+	idat.push_back(0x78);
+	idat.push_back(0x01);
+	deflate(raw, rowBytes, idat);
+	putBigEndian(idat, adler32(raw.data(), raw.size()));
+
+	std::vector<uint8_t> ihdr;
+	putBigEndian(ihdr, width);
+	putBigEndian(ihdr, height);
+	ihdr.push_back(8);     // Bits per channel
+	ihdr.push_back(2);     // RGB
+	ihdr.push_back(0);     // Deflate
+	ihdr.push_back(0);     // Adaptive filtering
+	ihdr.push_back(0);     // Not interlaced
+
+	static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+	out.assign(signature, signature + 8);
+	chunk(out, "IHDR", ihdr.data(), ihdr.size());
+	chunk(out, "IDAT", idat.data(), idat.size());
+	chunk(out, "IEND", NULL, 0);
+}
+
+bool PngEncoder::write(const std::string& path, const uint32_t* pixels, int width, int height, int pitch) {
+	std::vector<uint8_t> png;
+	encode(pixels, width, height, pitch, png);
+
+	std::ofstream file(path, std::ios::out | std::ios::binary);
+	if (!file)
+		return false;
+	file.write((const char*)png.data(), png.size());
+	return (bool)file;
+}
@@ -0,0 +1,30 @@
+#ifndef PNGENCODER_H
+#define PNGENCODER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Writes 8-bit RGB PNG files with a small built-in deflate encoder, so no zlib is needed
+// Only looks for repeats one byte back, one pixel back and one row back, which is what upscaled pixel art is made of
+class PngEncoder {
+public:
+	// Encode ARGB8888 pixels (alpha dropped), pitch in pixels, into a complete PNG file in out
+	static void encode(const uint32_t* pixels, int width, int height, int pitch, std::vector<uint8_t>& out);
+
+	// Encode and write to path, returns false if the file couldn't be written
+	static bool write(const std::string& path, const uint32_t* pixels, int width, int height, int pitch);
+
+	// Checksums PNG and zlib need; pass the previous result to continue one
+	static uint32_t crc32(const uint8_t* data, size_t size, uint32_t crc = 0);
+	static uint32_t adler32(const uint8_t* data, size_t size, uint32_t adler = 1);
+
+private:
+	// Raw deflate stream of data, one block with the fixed Huffman codes
+	static void deflate(const std::vector<uint8_t>& data, size_t rowBytes, std::vector<uint8_t>& out);
+
+	// Append a chunk with its length and CRC
+	static void chunk(std::vector<uint8_t>& out, const char* type, const uint8_t* data, size_t size);
+};
+
+#endif
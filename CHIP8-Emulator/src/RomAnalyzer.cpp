@@ -0,0 +1,409 @@
+#include "RomAnalyzer.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <filesystem>
+#include "constants.h"
+
+// How an instruction hands off control
+enum Flow {
+	FLOW_NEXT,      // Falls through to the next instruction
+	FLOW_JUMP,      // 1NNN
+	FLOW_CALL,      // 2NNN, continues at NNN and later at the return site
+	FLOW_SKIP,      // 3XNN, 4XNN, 5XY0, 9XY0, EX9E, EXA1
+	FLOW_RETURN,    // 00EE
+	FLOW_COMPUTED,  // BNNN
+	FLOW_STOP       // Unknown opcode, treated as data
+};
+
+static Flow classify(uint16_t opcode) {
+	switch (opcode & 0xF000) {
+	case 0x0000:
+		// 00CN, 00FB, 00FC, 00FE, 00FF are SUPER-CHIP display ops; 00FD exits so it ends the path
+		// 00DN is XO-CHIP's scroll up
+		if (opcode == 0x00E0 || (opcode & 0xFFF0) == 0x00C0 || (opcode & 0xFFF0) == 0x00D0)
+			return FLOW_NEXT;
+		if (opcode == 0x00FB || opcode == 0x00FC || opcode == 0x00FE || opcode == 0x00FF)
+			return FLOW_NEXT;
+		if (opcode == 0x00EE)
+			return FLOW_RETURN;
+		return FLOW_STOP;
+
+	case 0x1000:
+		return FLOW_JUMP;
+
+	case 0x2000:
+		return FLOW_CALL;
+
+	case 0x3000:
+	case 0x4000:
+		return FLOW_SKIP;
+
+	case 0x5000:
+		// 5XY2/5XY3 are XO-CHIP register range save/load
+		if ((opcode & 0x000F) == 2 || (opcode & 0x000F) == 3)
+			return FLOW_NEXT;
+		return (opcode & 0x000F) == 0 ? FLOW_SKIP : FLOW_STOP;
+
+	case 0x9000:
+		return (opcode & 0x000F) == 0 ? FLOW_SKIP : FLOW_STOP;
+
+	case 0x8000:
+		switch (opcode & 0x000F) {
+		case 0x0: case 0x1: case 0x2: case 0x3:
+		case 0x4: case 0x5: case 0x6: case 0x7: case 0xE:
+			return FLOW_NEXT;
+		default:
+			return FLOW_STOP;
+		}
+
+	case 0xB000:
+		return FLOW_COMPUTED;
+
+	case 0xE000:
+		switch (opcode & 0x00FF) {
+		case 0x9E: case 0xA1:
+			return FLOW_SKIP;
+		default:
+			return FLOW_STOP;
+		}
+
+	case 0xF000:
+		switch (opcode & 0x00FF) {
+		case 0x00: case 0x01: case 0x02: case 0x3A:
+		case 0x07: case 0x0A: case 0x15: case 0x18: case 0x1E:
+		case 0x29: case 0x30: case 0x33: case 0x55: case 0x65:
+		case 0x75: case 0x85:
+			return FLOW_NEXT;
+		default:
+			return FLOW_STOP;
+		}
+
+	default:
+		// 6XNN, 7XNN, ANNN, CXNN, DXYN
+		return FLOW_NEXT;
+	}
+}
+
+// XO-CHIP's F000 NNNN is the only instruction longer than two bytes
+static int instrLength(uint16_t opcode) {
+	return opcode == 0xF000 ? 4 : 2;
+}
+
+static bool inMemory(uint32_t addr) {
+	// Both bytes of the instruction need to be addressable
+	return addr + 1 < CH8_MEM_SIZE;
+}
+
+RomAnalyzer::RomAnalyzer() {
+	m_romHash = 0;
+	m_romSize = 0;
+}
+
+void RomAnalyzer::analyze(const std::vector<uint8_t>& rom) {
+	m_blocks.clear();
+	m_computedJumps.clear();
+	m_codeStores.clear();
+	m_romHash = hashRom(rom);
+	m_romSize = rom.size();
+
+	// Lay the ROM out the same way loadRom does
+	std::vector<uint8_t> mem(CH8_MEM_SIZE, 0);
+	for (size_t i = 0; i < rom.size() && 0x200 + i < CH8_MEM_SIZE; i++)
+		mem[0x200 + i] = rom[i];
+
+	auto fetch = [&mem](uint32_t addr) -> uint16_t {
+		return (mem[addr] << 8) | mem[addr + 1];
+	};
+
+	std::vector<bool> reachable(CH8_MEM_SIZE, false);
+	std::vector<bool> leader(CH8_MEM_SIZE, false);
+	std::vector<uint16_t> work;
+
+	auto addTarget = [&](uint32_t addr) {
+		if (!inMemory(addr))
+			return;
+		leader[addr] = true;
+		if (!reachable[addr])
+			work.push_back(addr);
+	};
+
+	// First pass: find every reachable instruction and every address a block must start at
+	addTarget(0x200);
+	while (!work.empty()) {
+		uint32_t addr = work.back();
+		work.pop_back();
+
+		while (inMemory(addr)) {
+			// Falling into code we've already walked means two paths join here
+			if (reachable[addr]) {
+				leader[addr] = true;
+				break;
+			}
+			reachable[addr] = true;
+
+			uint16_t opcode = fetch(addr);
+			Flow flow = classify(opcode);
+
+			if (flow == FLOW_NEXT) {
+				addr += instrLength(opcode);
+				continue;
+			}
+
+			if (flow == FLOW_JUMP)
+				addTarget(opcode & 0x0FFF);
+			else if (flow == FLOW_CALL) {
+				addTarget(opcode & 0x0FFF);
+				addTarget(addr + 2);
+			}
+			else if (flow == FLOW_SKIP) {
+				addTarget(addr + 2);
+				if (inMemory(addr + 2))
+					addTarget(addr + 2 + instrLength(fetch(addr + 2)));
+			}
+			break;
+		}
+	}
+
+	// Every byte that belongs to a reachable instruction
+	std::vector<bool> isCode(CH8_MEM_SIZE, false);
+	for (uint32_t addr = 0; addr < CH8_MEM_SIZE; addr++)
+		if (reachable[addr])
+			for (int i = 0; i < instrLength(fetch(addr)) && addr + i < CH8_MEM_SIZE; i++)
+				isCode[addr + i] = true;
+
+	// Second pass: cut the reachable code into blocks at each leader
+	for (uint32_t start = 0; start < CH8_MEM_SIZE; start++) {
+		if (!reachable[start] || !leader[start])
+			continue;
+
+		BasicBlock block;
+		block.start = start;
+		block.computedJump = false;
+		block.returns = false;
+
+		// Track I through ANNN so stores can be checked against code
+		bool iKnown = false;
+		uint16_t iVal = 0;
+
+		uint32_t addr = start;
+		while (true) {
+			uint16_t opcode = fetch(addr);
+			Flow flow = classify(opcode);
+
+			if ((opcode & 0xF000) == 0xA000) {
+				iKnown = true;
+				iVal = opcode & 0x0FFF;
+			}
+			else if (opcode == 0xF000 && inMemory(addr + 2)) {
+				iKnown = true;
+				iVal = fetch(addr + 2);
+			}
+			else if ((opcode & 0xF0FF) == 0xF01E || (opcode & 0xF0FF) == 0xF029 || (opcode & 0xF0FF) == 0xF030)
+				iKnown = false;
+			else if ((opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055 || (opcode & 0xF00F) == 0x5002) {
+				CodeStore store;
+				store.addr = addr;
+				store.targetKnown = iKnown;
+				store.first = iVal;
+				if ((opcode & 0xF000) == 0x5000) {
+					// 5XY2 stores |X - Y| + 1 registers
+					int vx = (opcode & 0x0F00) >> 8, vy = (opcode & 0x00F0) >> 4;
+					store.last = iVal + (vx > vy ? vx - vy : vy - vx);
+				}
+				else store.last = iVal + ((opcode & 0x00FF) == 0x33 ? 2 : (opcode & 0x0F00) >> 8);
+
+				bool hitsCode = !iKnown;
+				for (uint32_t a = store.first; iKnown && a <= store.last && a < CH8_MEM_SIZE; a++)
+					if (isCode[a])
+						hitsCode = true;
+				if (hitsCode)
+					m_codeStores.push_back(store);
+			}
+
+			if (flow == FLOW_NEXT) {
+				uint32_t next = addr + instrLength(opcode);
+				if (!inMemory(next) || !reachable[next]) {
+					// Runs off the end of memory
+					block.end = addr;
+					break;
+				}
+				if (leader[next]) {
+					block.end = addr;
+					block.successors.push_back(next);
+					break;
+				}
+				addr = next;
+				continue;
+			}
+
+			block.end = addr;
+			switch (flow) {
+			case FLOW_JUMP:
+				block.successors.push_back(opcode & 0x0FFF);
+				break;
+			case FLOW_CALL:
+				block.successors.push_back(opcode & 0x0FFF);
+				if (inMemory(addr + 2))
+					block.successors.push_back(addr + 2);
+				break;
+			case FLOW_SKIP:
+				if (inMemory(addr + 2)) {
+					uint32_t skipTo = addr + 2 + instrLength(fetch(addr + 2));
+					block.successors.push_back(addr + 2);
+					if (inMemory(skipTo))
+						block.successors.push_back(skipTo);
+				}
+				break;
+			case FLOW_RETURN:
+				block.returns = true;
+				break;
+			case FLOW_COMPUTED:
+				block.computedJump = true;
+				m_computedJumps.push_back(addr);
+				break;
+			default:
+				break;
+			}
+			break;
+		}
+
+		m_blocks.push_back(block);
+	}
+}
+
+bool RomAnalyzer::analyzeCached(const std::vector<uint8_t>& rom, const std::string& cacheDir) {
+	std::string path = cachePath(cacheDir, hashRom(rom));
+
+	if (loadCache(path) == SUCCESS && m_romHash == hashRom(rom) && m_romSize == rom.size())
+		return true;
+
+	analyze(rom);
+
+	std::error_code ec;
+	std::filesystem::create_directories(cacheDir, ec);
+	if (saveCache(path) != SUCCESS)
+		std::cerr << "Could not write CFG cache " << path << std::endl;
+
+	return false;
+}
+
+uint64_t RomAnalyzer::hashRom(const std::vector<uint8_t>& rom) {
+	uint64_t hash = 0xCBF29CE484222325ULL;
+	for (uint8_t b : rom) {
+		hash ^= b;
+		hash *= 0x100000001B3ULL;
+	}
+	return hash;
+}
+
+void RomAnalyzer::printReport(std::ostream& out) const {
+	out << std::hex << std::uppercase;
+	out << "ROM hash " << std::setw(16) << std::setfill('0') << m_romHash << std::setfill(' ') << "\n";
+	out << std::dec << m_blocks.size() << " basic blocks\n" << std::hex;
+
+	for (const BasicBlock& b : m_blocks) {
+		out << "  " << std::setw(3) << b.start << "-" << std::setw(3) << b.end << " ->";
+		for (uint16_t s : b.successors)
+			out << " " << s;
+		if (b.returns)
+			out << " (return)";
+		if (b.computedJump)
+			out << " (computed jump)";
+		out << "\n";
+	}
+
+	for (uint16_t addr : m_computedJumps)
+		out << "Computed jump (BNNN) at " << addr << "\n";
+
+	for (const CodeStore& s : m_codeStores) {
+		out << "Possible self-modifying store at " << s.addr;
+		if (s.targetKnown)
+			out << " into " << s.first << "-" << s.last << "\n";
+		else out << " (target unknown)\n";
+	}
+
+	out << std::dec << std::nouppercase;
+}
+
+std::string RomAnalyzer::cachePath(const std::string& cacheDir, uint64_t hash) {
+	std::ostringstream name;
+	name << cacheDir << "/" << std::hex << std::setw(16) << std::setfill('0') << hash << ".cfg";
+	return name.str();
+}
+
+// Cache file layout, one record per line:
+//   CH8CFG <version> <hash> <rom size>
+//   B <start> <end> <computed jump> <returns> <num successors> <successors...>
+//   J <addr>
+//   S <addr> <first> <last> <target known>
+int RomAnalyzer::saveCache(const std::string& path) const {
+	std::ofstream out(path, std::ios::out | std::ios::trunc);
+	if (!out)
+		return ERR_CACHE_WRITE;
+
+	out << "CH8CFG " << CFG_CACHE_VERSION << " " << m_romHash << " " << m_romSize << "\n";
+
+	for (const BasicBlock& b : m_blocks) {
+		out << "B " << b.start << " " << b.end << " " << b.computedJump << " " << b.returns << " " << b.successors.size();
+		for (uint16_t s : b.successors)
+			out << " " << s;
+		out << "\n";
+	}
+
+	for (uint16_t addr : m_computedJumps)
+		out << "J " << addr << "\n";
+
+	for (const CodeStore& s : m_codeStores)
+		out << "S " << s.addr << " " << s.first << " " << s.last << " " << s.targetKnown << "\n";
+
+	return out ? SUCCESS : ERR_CACHE_WRITE;
+}
+
+int RomAnalyzer::loadCache(const std::string& path) {
+	std::ifstream in(path);
+	if (!in)
+		return ERR_CACHE_READ;
+
+	std::string magic;
+	int version;
+	in >> magic >> version >> m_romHash >> m_romSize;
+	if (!in || magic != "CH8CFG" || version != CFG_CACHE_VERSION)
+		return ERR_CACHE_READ;
+
+	m_blocks.clear();
+	m_computedJumps.clear();
+	m_codeStores.clear();
+
+	std::string tag;
+	while (in >> tag) {
+		if (tag == "B") {
+			BasicBlock b;
+			size_t numSucc;
+			in >> b.start >> b.end >> b.computedJump >> b.returns >> numSucc;
+			for (size_t i = 0; in && i < numSucc; i++) {
+				uint16_t s;
+				in >> s;
+				b.successors.push_back(s);
+			}
+			m_blocks.push_back(b);
+		}
+		else if (tag == "J") {
+			uint16_t addr;
+			in >> addr;
+			m_computedJumps.push_back(addr);
+		}
+		else if (tag == "S") {
+			CodeStore s;
+			in >> s.addr >> s.first >> s.last >> s.targetKnown;
+			m_codeStores.push_back(s);
+		}
+		else return ERR_CACHE_READ;
+
+		if (!in)
+			return ERR_CACHE_READ;
+	}
+
+	return SUCCESS;
+}
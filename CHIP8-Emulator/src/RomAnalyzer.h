@@ -0,0 +1,83 @@
+#ifndef ROMANALYZER_H
+#define ROMANALYZER_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+#include "constants.h"
+
+// A straight run of instructions with a single entry and a single exit
+struct BasicBlock {
+	// Address of the first instruction in the block
+	uint16_t start;
+
+	// Address of the last instruction in the block
+	uint16_t end;
+
+	// Addresses of the blocks control can flow to after this one
+	std::vector<uint16_t> successors;
+
+	// Block ends in a BNNN whose target depends on V0 at runtime
+	bool computedJump;
+
+	// Block ends in 00EE, so its successor is whatever called it
+	bool returns;
+};
+
+// A store (FX33/FX55) whose destination may overlap reachable code
+struct CodeStore {
+	// Address of the store instruction
+	uint16_t addr;
+
+	// First and last byte written, only meaningful if targetKnown is set
+	uint16_t first, last;
+
+	// Whether I could be resolved from an ANNN earlier in the same block
+	bool targetKnown;
+};
+
+class RomAnalyzer {
+public:
+	RomAnalyzer();
+
+	// Walk the ROM from 0x200 and build its control-flow graph
+	void analyze(const std::vector<uint8_t>& rom);
+
+	// Use the cached result for this ROM if there is one, otherwise analyze it and store the result
+	// Returns true if the result came from the cache
+	bool analyzeCached(const std::vector<uint8_t>& rom, const std::string& cacheDir = CFG_CACHE_DIR);
+
+	// 64-bit FNV-1a hash of the ROM contents, used as the cache key
+	static uint64_t hashRom(const std::vector<uint8_t>& rom);
+
+	// Print a human-readable summary of the graph
+	void printReport(std::ostream& out) const;
+
+	// Results of the last analysis
+	const std::vector<BasicBlock>& getBlocks() const { return m_blocks; }
+	const std::vector<uint16_t>& getComputedJumps() const { return m_computedJumps; }
+	const std::vector<CodeStore>& getCodeStores() const { return m_codeStores; }
+	uint64_t getRomHash() const { return m_romHash; }
+
+private:
+	std::vector<BasicBlock> m_blocks;
+
+	// Addresses of every reachable BNNN
+	std::vector<uint16_t> m_computedJumps;
+
+	// Stores that may write into code
+	std::vector<CodeStore> m_codeStores;
+
+	uint64_t m_romHash;
+	uint32_t m_romSize;
+
+	// Path of the cache file for the current hash
+	static std::string cachePath(const std::string& cacheDir, uint64_t hash);
+
+	// Save/load the current results, return SUCCESS or an error code
+	int saveCache(const std::string& path) const;
+	int loadCache(const std::string& path);
+};
+
+#endif
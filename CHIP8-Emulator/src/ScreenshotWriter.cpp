@@ -0,0 +1,117 @@
+#include "ScreenshotWriter.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+#include "PngEncoder.h"
+
+ScreenshotWriter::ScreenshotWriter() {
+	m_first = 0;
+	m_count = 0;
+	m_stopping = false;
+	m_written = 0;
+	m_dropped = 0;
+}
+
+ScreenshotWriter::~ScreenshotWriter() {
+	stop();
+}
+
+bool ScreenshotWriter::queue(const DisplayFrame& f, const uint32_t palette[1 << XO_NUM_PLANES], const std::string& path) {
+	std::lock_guard<std::mutex> lock(m_lock);
+
+	if (m_count == SCREENSHOT_QUEUE_SIZE) {
+		++m_dropped;
+		return false;
+	}
+
+	// The writer only touches the slots already counted, so this one is free to fill
+	Shot& shot = m_shots[(m_first + m_count) % SCREENSHOT_QUEUE_SIZE];
+	shot.hiRes = f.hiRes;
+	shot.megaMode = f.megaMode;
+	if (f.megaMode)
+		shot.mega.assign(f.mega.begin(), f.mega.end());
+	else memcpy(shot.gfx, f.gfx, sizeof(shot.gfx));
+	for (int i = 0; i < (1 << XO_NUM_PLANES); i++)
+		shot.palette[i] = palette[i];
+	shot.path = path;
+	++m_count;
+
+	// Started on first use so an emulator that never takes a screenshot never has the thread
+	if (!m_thread.joinable()) {
+		m_stopping = false;
+		m_thread = std::thread(&ScreenshotWriter::run, this);
+	}
+
+	m_wake.notify_one();
+	return true;
+}
+
+void ScreenshotWriter::stop() {
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_stopping = true;
+	}
+	m_wake.notify_one();
+
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void ScreenshotWriter::run() {
+	std::unique_lock<std::mutex> lock(m_lock);
+
+	while (true) {
+		m_wake.wait(lock, [this] { return m_count > 0 || m_stopping; });
+		if (m_count == 0)
+			break;
+
+		// The slot stays counted while it's being saved, so queue can't reuse it
+		const Shot& shot = m_shots[m_first];
+		lock.unlock();
+		bool saved = save(shot);
+		lock.lock();
+
+		m_first = (m_first + 1) % SCREENSHOT_QUEUE_SIZE;
+		--m_count;
+		if (saved)
+			++m_written;
+		else ++m_dropped;
+	}
+}
+
+bool ScreenshotWriter::save(const Shot& shot) {
+	const int width = shot.megaMode ? MEGA_WIDTH : shot.hiRes ? SCHIP_WIDTH : CH8_WIDTH;
+	const int height = shot.megaMode ? MEGA_HEIGHT : shot.hiRes ? SCHIP_HEIGHT : CH8_HEIGHT;
+
+	// Nearest-neighbor scaled to about the default window width, like the window shows it
+	const int factor = std::max(1, SCREENSHOT_WIDTH / width);
+	const int outWidth = width * factor;
+	const int outHeight = height * factor;
+	m_pixels.resize((size_t)outWidth * outHeight);
+
+	m_expander.setPalette(shot.palette);
+	uint32_t row[MEGA_WIDTH > SCHIP_WIDTH ? MEGA_WIDTH : SCHIP_WIDTH];
+	const int words = shot.hiRes ? CH8_ROW_WORDS : 1;
+
+	for (int y = 0; y < height; y++) {
+		const uint32_t* src = row;
+		if (shot.megaMode)
+			src = &shot.mega[y * MEGA_WIDTH];
+		else m_expander.expandRow(&shot.gfx[0][y * words], &shot.gfx[1][y * words], width, row);
+
+		// Widen the row once, then copy it down for the rest of the block
+		uint32_t* dst = &m_pixels[(size_t)y * factor * outWidth];
+		for (int x = 0; x < width; x++)
+			std::fill(dst + x * factor, dst + (x + 1) * factor, src[x]);
+		for (int r = 1; r < factor; r++)
+			std::copy(dst, dst + outWidth, dst + r * outWidth);
+	}
+
+	if (!PngEncoder::write(shot.path, m_pixels.data(), outWidth, outHeight, outWidth)) {
+		std::cerr << "Could not write screenshot " << shot.path << std::endl;
+		return false;
+	}
+
+	std::cout << "Saved screenshot " << shot.path << "\n";
+	return true;
+}
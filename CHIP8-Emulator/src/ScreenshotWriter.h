@@ -0,0 +1,72 @@
+#ifndef SCREENSHOTWRITER_H
+#define SCREENSHOTWRITER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include "DisplayFrame.h"
+#include "PixelExpander.h"
+#include "constants.h"
+
+// Saves screenshots as PNG on a thread of its own
+// Queuing one only copies the packed display into a preallocated slot; expanding, scaling,
+// encoding and writing all happen on the writer thread, so bursts can't stall the game
+class ScreenshotWriter {
+public:
+	ScreenshotWriter();
+
+	// Finishes whatever is queued first
+	~ScreenshotWriter();
+
+	// Queue f to be saved to path with the given palette
+	// Returns false without waiting if SCREENSHOT_QUEUE_SIZE shots are already waiting
+	bool queue(const DisplayFrame& f, const uint32_t palette[1 << XO_NUM_PLANES], const std::string& path);
+
+	// Write everything queued, then stop the thread; queue starts it again
+	void stop();
+
+	// Shots written, and shots dropped because the queue was full or the file couldn't be written
+	unsigned long getWritten() const { return m_written; }
+	unsigned long getDropped() const { return m_dropped; }
+
+private:
+	struct Shot {
+		uint64_t gfx[XO_NUM_PLANES][SCHIP_HEIGHT * CH8_ROW_WORDS];
+		bool hiRes;
+		bool megaMode;
+
+		// Only filled in for MegaChip frames; keeps its capacity between shots
+		std::vector<uint32_t> mega;
+
+		uint32_t palette[1 << XO_NUM_PLANES];
+		std::string path;
+	};
+
+	// Ring of shots, m_count of them from m_first are waiting or being written
+	Shot m_shots[SCREENSHOT_QUEUE_SIZE];
+	int m_first, m_count;
+
+	std::mutex m_lock;
+	std::condition_variable m_wake;
+	std::thread m_thread;
+	bool m_stopping;
+
+	std::atomic<unsigned long> m_written;
+	std::atomic<unsigned long> m_dropped;
+
+	// Only used on the writer thread
+	PixelExpander m_expander;
+	std::vector<uint32_t> m_pixels;
+
+	// Writer thread: take the oldest shot, save it, repeat until stopped and empty
+	void run();
+
+	// Expand, scale and encode one shot
+	bool save(const Shot& shot);
+};
+
+#endif
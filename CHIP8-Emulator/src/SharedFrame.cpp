@@ -0,0 +1,249 @@
+#include "SharedFrame.h"
+#include <iostream>
+#include <cstring>
+#include "Chip8.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "seq has to work across processes");
+
+// Everything from frame up to mega, the part that's copied every frame whatever the mode
+static size_t frameFieldsSize(const SharedFrameLayout* s) {
+	return (const char*)s->mega - (const char*)&s->frame;
+}
+
+// Map name's region, creating it if create is set; returns NULL on failure
+static void* mapRegion(const std::string& name, bool create, void** mapping) {
+	const size_t size = sizeof(SharedFrameLayout);
+
+#ifdef _WIN32
+	std::string path = "Local\\" + name;
+	HANDLE h = create
+		? CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, 0, (DWORD)size, path.c_str())
+		: OpenFileMappingA(FILE_MAP_READ, FALSE, path.c_str());
+	if (h == NULL)
+		return NULL;
+
+	void* p = MapViewOfFile(h, create ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, size);
+	if (p == NULL) {
+		CloseHandle(h);
+		return NULL;
+	}
+	*mapping = h;
+	return p;
+#else
+	(void)mapping;
+	std::string path = "/" + name;
+	int fd = create ? shm_open(path.c_str(), O_CREAT | O_RDWR, 0600) : shm_open(path.c_str(), O_RDONLY, 0);
+	if (fd < 0)
+		return NULL;
+
+	if (create && ftruncate(fd, size) != 0) {
+		::close(fd);
+		return NULL;
+	}
+
+	// The mapping keeps the region alive on its own
+	void* p = mmap(NULL, size, create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+	::close(fd);
+	return p == MAP_FAILED ? NULL : p;
+#endif
+}
+
+static void unmapRegion(const void* p, void* mapping) {
+#ifdef _WIN32
+	UnmapViewOfFile(p);
+	CloseHandle(mapping);
+#else
+	(void)mapping;
+	munmap((void*)p, sizeof(SharedFrameLayout));
+#endif
+}
+
+SharedFrameExport::SharedFrameExport() {
+	m_shared = NULL;
+#ifdef _WIN32
+	m_mapping = NULL;
+#endif
+}
+
+SharedFrameExport::~SharedFrameExport() {
+	close();
+}
+
+bool SharedFrameExport::open(const std::string& name, const uint32_t palette[1 << XO_NUM_PLANES]) {
+	close();
+
+	void* mapping = NULL;
+	void* p = mapRegion(name, true, &mapping);
+	if (p == NULL) {
+		std::cerr << "Could not create shared memory " << name << std::endl;
+		return false;
+	}
+
+	// A fresh region is zeroed, so readers see magic 0 until the header is done
+	m_shared = (SharedFrameLayout*)p;
+	m_name = name;
+#ifdef _WIN32
+	m_mapping = mapping;
+#endif
+
+	m_shared->magic = 0;
+	m_shared->alive.store(0, std::memory_order_relaxed);
+	m_shared->version = SHARED_FRAME_VERSION;
+	m_shared->size = sizeof(SharedFrameLayout);
+	m_shared->frame = 0;
+	for (int i = 0; i < (1 << XO_NUM_PLANES); i++)
+		m_shared->palette[i] = palette[i];
+
+	// Left as it was, so a reader still attached from an earlier run sees the count move on
+	uint32_t seq = m_shared->seq.load(std::memory_order_relaxed);
+	m_shared->seq.store(seq & ~1u, std::memory_order_relaxed);
+
+	m_shared->alive.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	m_shared->magic = SHARED_FRAME_MAGIC;
+	return true;
+}
+
+void SharedFrameExport::close() {
+	if (m_shared == NULL)
+		return;
+
+	m_shared->alive.store(0, std::memory_order_release);
+#ifdef _WIN32
+	unmapRegion(m_shared, m_mapping);
+	m_mapping = NULL;
+#else
+	unmapRegion(m_shared, NULL);
+
+	// Readers that still have it mapped keep their copy; new ones won't find it
+	shm_unlink(("/" + m_name).c_str());
+#endif
+	m_shared = NULL;
+}
+
+void SharedFrameExport::publish(const Chip8& chip) {
+	if (m_shared == NULL)
+		return;
+
+	SharedFrameLayout* s = m_shared;
+	uint32_t seq = s->seq.load(std::memory_order_relaxed);
+
+	// Mark the frame as being written before touching it, same as Chip8::publishState
+	s->seq.store(seq + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	++s->frame;
+	s->cycles = chip.getCycleCount();
+	s->pc = chip.getPC();
+	s->I = chip.getI();
+	memcpy(s->V, chip.getV(), sizeof(s->V));
+	s->dTimer = chip.getDelayTimer();
+	s->sTimer = chip.getSoundTimer();
+	s->hiRes = chip.isHiRes();
+	s->megaMode = chip.isMegaChip();
+
+	if (s->megaMode) {
+		s->width = MEGA_WIDTH;
+		s->height = MEGA_HEIGHT;
+
+		// 00E0 composes as it shows a frame, so this matches the registers above even though the
+		// screen hasn't drawn it yet
+		memcpy(s->mega, chip.getMegaDisplay().getComposed(), sizeof(s->mega));
+	}
+	else {
+		s->width = (uint16_t)chip.getWidth();
+		s->height = (uint16_t)chip.getHeight();
+
+		// Rows are back to back, so only the part in use needs copying
+		const size_t words = (size_t)chip.getRowWords() * chip.getHeight();
+		for (int p = 0; p < XO_NUM_PLANES; p++)
+			memcpy(s->gfx[p], chip.getRow(p, 0), words * sizeof(uint64_t));
+	}
+
+	s->seq.store(seq + 2, std::memory_order_release);
+}
+
+SharedFrameReader::SharedFrameReader() {
+	m_shared = NULL;
+#ifdef _WIN32
+	m_mapping = NULL;
+#endif
+}
+
+SharedFrameReader::~SharedFrameReader() {
+	detach();
+}
+
+bool SharedFrameReader::attach(const std::string& name) {
+	detach();
+
+	void* mapping = NULL;
+	const SharedFrameLayout* p = (const SharedFrameLayout*)mapRegion(name, false, &mapping);
+	if (p == NULL)
+		return false;
+
+	// Also catches a region from a build with a different layout
+	if (p->magic != SHARED_FRAME_MAGIC || p->version != SHARED_FRAME_VERSION || p->size != sizeof(SharedFrameLayout)) {
+		unmapRegion(p, mapping);
+		return false;
+	}
+
+	m_shared = p;
+#ifdef _WIN32
+	m_mapping = mapping;
+#endif
+	return true;
+}
+
+void SharedFrameReader::detach() {
+	if (m_shared == NULL)
+		return;
+#ifdef _WIN32
+	unmapRegion(m_shared, m_mapping);
+	m_mapping = NULL;
+#else
+	unmapRegion(m_shared, NULL);
+#endif
+	m_shared = NULL;
+}
+
+bool SharedFrameReader::read(SharedFrameLayout& out) const {
+	if (m_shared == NULL)
+		return false;
+	const SharedFrameLayout* s = m_shared;
+
+	for (int attempt = 0; attempt < SHARED_FRAME_READ_ATTEMPTS; attempt++) {
+		if (!s->alive.load(std::memory_order_acquire))
+			return false;
+
+		uint32_t before = s->seq.load(std::memory_order_acquire);
+
+		// Writer is in the middle of a frame
+		if (before & 1)
+			continue;
+
+		memcpy(&out.frame, &s->frame, frameFieldsSize(s));
+		if (out.megaMode)
+			memcpy(out.mega, s->mega, sizeof(out.mega));
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (s->seq.load(std::memory_order_relaxed) == before) {
+			out.magic = s->magic;
+			out.version = s->version;
+			out.size = s->size;
+			out.seq.store(before, std::memory_order_relaxed);
+			out.alive.store(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,100 @@
+#ifndef SHAREDFRAME_H
+#define SHAREDFRAME_H
+
+#include <cstdint>
+#include <string>
+#include <atomic>
+#include "constants.h"
+
+class Chip8;
+
+// What the emulator puts in shared memory at the end of every 60 Hz frame
+// Readers map it and read it in place, checking seq like a seqlock: an odd value means a frame is being
+// written, and a value that changed between reading it before and after means the copy is torn
+// Every field is a fixed size and in the machine's own byte order
+struct SharedFrameLayout {
+	uint32_t magic;                  // SHARED_FRAME_MAGIC once the writer has set it up
+	uint32_t version;                // SHARED_FRAME_VERSION
+	uint32_t size;                   // sizeof(SharedFrameLayout)
+	std::atomic<uint32_t> seq;
+	std::atomic<uint32_t> alive;     // Cleared when the emulator stops publishing
+
+	// Frames published since the export opened, and instructions run since the ROM started
+	uint64_t frame;
+	uint64_t cycles;
+
+	uint16_t pc;
+	uint16_t dTimer;
+	uint32_t I;
+	uint8_t V[16];
+	uint16_t sTimer;
+	uint8_t hiRes;
+	uint8_t megaMode;
+
+	// Size of the picture in pixels: gfx in CHIP-8 modes, mega in MegaChip mode
+	uint16_t width;
+	uint16_t height;
+
+	// Colors of the plane combinations in gfx, 0xAARRGGBB
+	uint32_t palette[1 << XO_NUM_PLANES];
+
+	// Same layout as Chip8::gfx, only the first width / 64 * height words of each plane are in use
+	uint64_t gfx[XO_NUM_PLANES][SCHIP_HEIGHT * CH8_ROW_WORDS];
+
+	// The MegaChip frame last shown by 00E0, ARGB, only kept up to date in MegaChip mode
+	uint32_t mega[MEGA_WIDTH * MEGA_HEIGHT];
+};
+
+// Publishes the display and registers into a named shared memory region, shm_open on POSIX and a
+// pagefile-backed file mapping on Windows, so any local process can watch the game without a socket
+class SharedFrameExport {
+public:
+	SharedFrameExport();
+
+	// Unmaps and removes the region
+	~SharedFrameExport();
+
+	// Create the region, shown to readers as /name on POSIX and Local\name on Windows
+	bool open(const std::string& name, const uint32_t palette[1 << XO_NUM_PLANES]);
+	void close();
+
+	bool isOpen() const { return m_shared != NULL; }
+
+	// Copy the finished frame in, from whichever thread owns chip
+	void publish(const Chip8& chip);
+
+private:
+	SharedFrameLayout* m_shared;
+	std::string m_name;
+
+#ifdef _WIN32
+	void* m_mapping;
+#endif
+};
+
+// Reader side, for tools that would rather not deal with the mapping and the seqlock themselves
+class SharedFrameReader {
+public:
+	SharedFrameReader();
+	~SharedFrameReader();
+
+	// Map an existing region read-only; fails if nothing is exporting under name
+	bool attach(const std::string& name);
+	void detach();
+
+	// The region itself, to read in place
+	const SharedFrameLayout* get() const { return m_shared; }
+
+	// Copy a consistent frame into out, the MegaChip picture only in MegaChip mode
+	// Returns false if the writer kept getting in the way or has stopped
+	bool read(SharedFrameLayout& out) const;
+
+private:
+	const SharedFrameLayout* m_shared;
+
+#ifdef _WIN32
+	void* m_mapping;
+#endif
+};
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// Defines CH8_HAVE_SSE2 and pulls in the SSE2 intrinsics when the whole build may use them
+// SSE2 is always there on x64; on x86 MSVC only says so with /arch:SSE2 or higher
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CH8_HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+#endif
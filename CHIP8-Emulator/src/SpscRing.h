@@ -0,0 +1,52 @@
+#ifndef SPSCRING_H
+#define SPSCRING_H
+
+#include <atomic>
+#include <cstdint>
+
+// Passes values in order from one writer thread to one reader thread without locks
+// Each side only ever stores its own counter, so neither waits on the other; Size has to be a power of two
+template <typename T, uint32_t Size>
+class SpscRing {
+	static_assert((Size & (Size - 1)) == 0, "SpscRing size has to be a power of two");
+
+public:
+	SpscRing() : m_head(0), m_tail(0) {}
+
+	// Writer: add v after the others, returns false if the ring is full
+	bool push(const T& v) {
+		uint32_t head = m_head.load(std::memory_order_relaxed);
+		if (head - m_tail.load(std::memory_order_acquire) == Size)
+			return false;
+		m_slots[head & (Size - 1)] = v;
+		m_head.store(head + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Reader: the oldest value, NULL if there's none; it stays put until pop
+	const T* peek() const {
+		uint32_t tail = m_tail.load(std::memory_order_relaxed);
+		if (tail == m_head.load(std::memory_order_acquire))
+			return NULL;
+		return &m_slots[tail & (Size - 1)];
+	}
+
+	// Reader: let the writer have the oldest value's slot back
+	void pop() {
+		m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+
+	// Either side: how many values are waiting, already out of date by the time it returns
+	uint32_t size() const {
+		return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+	}
+
+private:
+	T m_slots[Size];
+
+	// Free-running counts of values pushed and popped; the slot is the count modulo Size
+	std::atomic<uint32_t> m_head;
+	std::atomic<uint32_t> m_tail;
+};
+
+#endif
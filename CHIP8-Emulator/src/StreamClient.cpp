@@ -0,0 +1,248 @@
+#include "StreamClient.h"
+#include <iostream>
+#include <cstring>
+#include <SDL.h>
+#include "Emulator.h"
+#include "PixelExpander.h"
+#include "TerminalRenderer.h"
+
+// How long connect waits for the server's hello, in polls of STREAM_POLL_MS
+static const int HELLO_POLLS = 500;
+
+StreamClient::StreamClient() {
+	m_socket = NO_SOCKET;
+	m_hasFrame = false;
+	m_keys = 0;
+	m_bytesReceived = 0;
+	m_frames = 0;
+	for (int i = 0; i < (1 << XO_NUM_PLANES); i++)
+		m_palette[i] = CH8_PALETTE[i];
+	memset(m_frame.gfx, 0, sizeof(m_frame.gfx));
+	m_frame.hiRes = false;
+	m_frame.megaMode = false;
+	m_frame.dirty = 0;
+	m_frame.time = 0;
+}
+
+StreamClient::~StreamClient() {
+	disconnect();
+}
+
+bool StreamClient::connect(const std::string& address) {
+	disconnect();
+
+	m_socket = StreamSocket::connectTo(address);
+	if (m_socket == NO_SOCKET) {
+		std::cerr << "Could not connect to " << address << std::endl;
+		return false;
+	}
+	StreamSocket::setNonBlocking(m_socket);
+
+	// Nothing else counts until the hello has said who's on the other end
+	std::vector<socket_t> read(1, m_socket), write;
+	std::vector<bool> readReady, writeReady;
+	for (int i = 0; i < HELLO_POLLS && m_in.size() < 5 + 5 + 4 * (1 << XO_NUM_PLANES); i++) {
+		if (!StreamSocket::wait(read, write, STREAM_POLL_MS, readReady, writeReady))
+			break;
+		if (!readReady[0])
+			continue;
+
+		uint8_t buf[256];
+		long n = StreamSocket::receiveSome(m_socket, buf, sizeof(buf));
+		if (n < 0)
+			break;
+		m_in.insert(m_in.end(), buf, buf + n);
+		m_bytesReceived += n;
+	}
+
+	long size = FrameStream::messageSize(m_in.data(), m_in.size());
+	if (size <= 0 || !FrameStream::readHello(m_in.data(), size, m_palette)) {
+		std::cerr << address << " isn't a CHIP-8 stream of version " << STREAM_VERSION << std::endl;
+		disconnect();
+		return false;
+	}
+	m_in.erase(m_in.begin(), m_in.begin() + size);
+	return applyMessages();
+}
+
+void StreamClient::disconnect() {
+	StreamSocket::close(m_socket);
+	m_socket = NO_SOCKET;
+	m_in.clear();
+	m_hasFrame = false;
+	m_keys = 0;
+}
+
+bool StreamClient::poll(int ms) {
+	if (m_socket == NO_SOCKET)
+		return false;
+
+	std::vector<socket_t> read(1, m_socket), write;
+	std::vector<bool> readReady, writeReady;
+	if (!StreamSocket::wait(read, write, ms, readReady, writeReady))
+		return false;
+	if (!readReady[0])
+		return true;
+
+	uint8_t buf[4096];
+	long n;
+	while ((n = StreamSocket::receiveSome(m_socket, buf, sizeof(buf))) > 0) {
+		m_in.insert(m_in.end(), buf, buf + n);
+		m_bytesReceived += n;
+	}
+	if (n < 0 || !applyMessages()) {
+		disconnect();
+		return false;
+	}
+	return true;
+}
+
+bool StreamClient::applyMessages() {
+	size_t used = 0;
+	while (true) {
+		long size = FrameStream::messageSize(m_in.data() + used, m_in.size() - used);
+		if (size < 0)
+			return false;
+		if (size == 0)
+			break;
+
+		const uint8_t* m = m_in.data() + used;
+
+		// A delta only makes sense on top of a keyframe
+		if (m[0] == STREAM_KEYFRAME || (m[0] == STREAM_DELTA && m_hasFrame)) {
+			if (!FrameStream::applyFrame(m, size, m_frame))
+				return false;
+			m_hasFrame = true;
+			++m_frames;
+		}
+		used += size;
+	}
+	m_in.erase(m_in.begin(), m_in.begin() + used);
+	return true;
+}
+
+void StreamClient::sendKeys(uint16_t keys) {
+	if (m_socket == NO_SOCKET || keys == m_keys)
+		return;
+	m_keys = keys;
+
+	// Small enough to always go out in one piece
+	std::vector<uint8_t> out;
+	FrameStream::encodeKeys(keys, out);
+	StreamSocket::sendSome(m_socket, out.data(), out.size());
+}
+
+int StreamClient::run(const std::string& address, int terminalStyle) {
+	if (terminalStyle != TERM_NONE) {
+		if (!connect(address))
+			return ERR_STREAM;
+
+		TerminalRenderer terminal;
+		terminal.setStyle(terminalStyle);
+		terminal.setPalette(m_palette);
+		terminal.begin();
+		while (poll((int)TARGET_FRAMETIME_MILLISECONDS)) {
+			if (m_hasFrame && m_frame.dirty) {
+				terminal.draw(m_frame);
+				m_frame.dirty = 0;
+			}
+		}
+		terminal.end();
+		std::cout << "Stream ended, " << m_frames << " frames, " << m_bytesReceived << " bytes\n";
+		return SUCCESS;
+	}
+
+	if (!SDL_WasInit(SDL_INIT_VIDEO) && SDL_InitSubSystem(SDL_INIT_VIDEO | SDL_INIT_EVENTS) != 0) {
+		std::cerr << "Could not initialize SDL. SDL Error: " << SDL_GetError() << std::endl;
+		return ERR_INIT_SDL;
+	}
+
+	if (!connect(address))
+		return ERR_STREAM;
+
+	SDL_Window* window = SDL_CreateWindow(("CHIP-8 - " + address).c_str(),
+		SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+		CH8_WIDTH * DEFAULT_SCALE, CH8_HEIGHT * DEFAULT_SCALE,
+		SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+	SDL_Renderer* renderer = window ? SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED) : NULL;
+	SDL_Texture* texture = renderer ? SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+		SDL_TEXTUREACCESS_STREAMING, SCHIP_WIDTH, SCHIP_HEIGHT) : NULL;
+
+	if (texture == NULL) {
+		std::cerr << "Could not create the viewer window. SDL Error: " << SDL_GetError() << std::endl;
+		if (renderer)
+			SDL_DestroyRenderer(renderer);
+		if (window)
+			SDL_DestroyWindow(window);
+		return ERR_INIT_SDL;
+	}
+
+	PixelExpander expander;
+	expander.setPalette(m_palette);
+	const uint8_t* keystate = SDL_GetKeyboardState(NULL);
+	bool redraw = false;
+	bool quit = false;
+
+	while (!quit) {
+		SDL_Event e;
+		while (SDL_PollEvent(&e)) {
+			if (e.type == SDL_QUIT)
+				quit = true;
+			else if (e.type == SDL_WINDOWEVENT &&
+				(e.window.event == SDL_WINDOWEVENT_EXPOSED || e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED))
+				redraw = true;
+		}
+
+		// Same keys as playing locally
+		bool keys[16];
+		Emulator::mapKeys(keystate, keys);
+		uint16_t mask = 0;
+		for (int i = 0; i < 16; i++)
+			mask |= keys[i] << i;
+		sendKeys(mask);
+
+		if (!poll(STREAM_POLL_MS)) {
+			std::cout << "Stream ended\n";
+			break;
+		}
+
+		// Only the band of rows the stream changed goes up; a locked texture's old contents can't be relied on,
+		// so every row inside the band is expanded again
+		if (m_hasFrame && m_frame.dirty) {
+			const int width = m_frame.getWidth();
+			const int height = m_frame.getHeight();
+			int first = 0, last = height - 1;
+			while (first < last && !(m_frame.dirty & (1ULL << first)))
+				++first;
+			while (last > first && !(m_frame.dirty & (1ULL << last)))
+				--last;
+
+			SDL_Rect band = { 0, first, width, last - first + 1 };
+			void* pixels;
+			int pitch;
+			if (SDL_LockTexture(texture, &band, &pixels, &pitch) == 0) {
+				for (int y = first; y <= last; y++)
+					expander.expandRow(m_frame.getRow(0, y), m_frame.getRow(1, y), width,
+						(uint32_t*)((uint8_t*)pixels + (y - first) * pitch));
+				SDL_UnlockTexture(texture);
+			}
+			SDL_RenderSetLogicalSize(renderer, width, height);
+			m_frame.dirty = 0;
+			redraw = true;
+		}
+
+		if (redraw) {
+			SDL_Rect src = { 0, 0, m_frame.getWidth(), m_frame.getHeight() };
+			SDL_RenderClear(renderer);
+			SDL_RenderCopy(renderer, texture, &src, NULL);
+			SDL_RenderPresent(renderer);
+			redraw = false;
+		}
+	}
+
+	std::cout << m_frames << " frames, " << m_bytesReceived << " bytes received\n";
+	SDL_DestroyTexture(texture);
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	return SUCCESS;
+}
@@ -0,0 +1,55 @@
+#ifndef STREAMCLIENT_H
+#define STREAMCLIENT_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "DisplayFrame.h"
+#include "FrameStream.h"
+#include "constants.h"
+
+// Reference viewer for StreamServer: follows the stream into a DisplayFrame and sends keys back
+// run() shows it in a window, or in the terminal like TerminalRenderer does for the emulator
+class StreamClient {
+public:
+	StreamClient();
+	~StreamClient();
+
+	// Connect and wait for the server's hello
+	bool connect(const std::string& address);
+	void disconnect();
+
+	// Wait up to ms for data and apply every complete message; returns false once the connection is gone
+	bool poll(int ms);
+
+	// The display as the server last sent it; its dirty rows build up until cleared
+	DisplayFrame& getFrame() { return m_frame; }
+	const uint32_t* getPalette() const { return m_palette; }
+
+	// Tell the server which keys are held, bit n for key n; only sent when it changes
+	void sendKeys(uint16_t keys);
+
+	// Bytes and frames received so far
+	uint64_t getBytesReceived() const { return m_bytesReceived; }
+	unsigned long getFrames() const { return m_frames; }
+
+	// Connect and show the stream until the window closes or the server goes away
+	// With a TerminalStyle other than TERM_NONE it draws in the terminal and sends no keys
+	int run(const std::string& address, int terminalStyle);
+
+private:
+	socket_t m_socket;
+	std::vector<uint8_t> m_in;
+	DisplayFrame m_frame;
+	bool m_hasFrame;
+	uint32_t m_palette[1 << XO_NUM_PLANES];
+	uint16_t m_keys;
+
+	uint64_t m_bytesReceived;
+	unsigned long m_frames;
+
+	// Apply the complete messages in m_in; false if one is malformed
+	bool applyMessages();
+};
+
+#endif
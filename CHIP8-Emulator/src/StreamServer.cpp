@@ -0,0 +1,224 @@
+#include "StreamServer.h"
+#include <iostream>
+#include <cstring>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+StreamServer::StreamServer() {
+	m_listen = NO_SOCKET;
+	m_running = false;
+	m_version = 0;
+	m_hasPublished = false;
+	m_currentVersion = 0;
+	m_keys = 0;
+	m_viewers = 0;
+	m_bytesSent = 0;
+	for (int i = 0; i < (1 << XO_NUM_PLANES); i++)
+		m_palette[i] = CH8_PALETTE[i];
+}
+
+StreamServer::~StreamServer() {
+	stop();
+}
+
+bool StreamServer::start(const std::string& address, const uint32_t palette[1 << XO_NUM_PLANES]) {
+	stop();
+
+	m_listen = StreamSocket::listenOn(address);
+	if (m_listen == NO_SOCKET) {
+		std::cerr << "Could not listen on " << address << std::endl;
+		return false;
+	}
+
+	m_address = address;
+	for (int i = 0; i < (1 << XO_NUM_PLANES); i++)
+		m_palette[i] = palette[i];
+	m_version = 0;
+	m_hasPublished = false;
+	m_currentVersion = 0;
+	m_keys = 0;
+	m_bytesSent = 0;
+
+	m_running = true;
+	m_thread = std::thread(&StreamServer::run, this);
+	return true;
+}
+
+void StreamServer::stop() {
+	if (!m_running)
+		return;
+
+	m_running = false;
+	m_thread.join();
+
+	for (Viewer& v : m_connections)
+		StreamSocket::close(v.socket);
+	m_connections.clear();
+	m_viewers = 0;
+	m_keys = 0;
+
+	StreamSocket::close(m_listen);
+	m_listen = NO_SOCKET;
+
+#ifndef _WIN32
+	if (m_address.compare(0, 5, "unix:") == 0)
+		unlink(m_address.substr(5).c_str());
+#endif
+}
+
+void StreamServer::consumeFrame(const DisplayFrame& frame, uint64_t /*number*/) {
+	if (!m_running)
+		return;
+
+	// Most frames change nothing, and those never reach the lock
+	FrameStream::convert(frame, m_offered);
+	if (m_hasPublished && FrameStream::sameFrame(m_offered, m_published))
+		return;
+
+	{
+		std::lock_guard<std::mutex> lock(m_lock);
+		m_latest = m_offered;
+		++m_version;
+	}
+	m_published = m_offered;
+	m_hasPublished = true;
+}
+
+void StreamServer::run() {
+	std::vector<socket_t> readList, writeList;
+	std::vector<bool> readReady, writeReady;
+
+	while (m_running) {
+		{
+			std::lock_guard<std::mutex> lock(m_lock);
+			if (m_version != m_currentVersion) {
+				m_current = m_latest;
+				m_currentVersion = m_version;
+			}
+		}
+
+		for (Viewer& v : m_connections)
+			queueFrame(v);
+
+		// The listening socket first, then every viewer, the ones with something to send for writing too
+		readList.assign(1, m_listen);
+		writeList.clear();
+		for (const Viewer& v : m_connections) {
+			readList.push_back(v.socket);
+			writeList.push_back(v.sent < v.out.size() ? v.socket : NO_SOCKET);
+		}
+
+		if (!StreamSocket::wait(readList, writeList, STREAM_POLL_MS, readReady, writeReady))
+			continue;
+
+		// Viewers that hang up are only marked here, so indices still line up with the lists
+		for (size_t i = 0; i < m_connections.size(); i++) {
+			Viewer& v = m_connections[i];
+			bool alive = true;
+			if (readReady[i + 1])
+				alive = readViewer(v);
+			if (alive && writeReady[i])
+				alive = writeViewer(v);
+			if (!alive) {
+				StreamSocket::close(v.socket);
+				v.socket = NO_SOCKET;
+			}
+		}
+
+		size_t kept = 0;
+		for (size_t i = 0; i < m_connections.size(); i++) {
+			if (m_connections[i].socket == NO_SOCKET)
+				continue;
+			if (kept != i)
+				m_connections[kept] = std::move(m_connections[i]);
+			++kept;
+		}
+		m_connections.resize(kept);
+
+		if (readReady[0]) {
+			socket_t s;
+			while ((s = StreamSocket::acceptFrom(m_listen)) != NO_SOCKET) {
+				if ((int)m_connections.size() >= STREAM_MAX_CLIENTS) {
+					StreamSocket::close(s);
+					continue;
+				}
+
+				Viewer v;
+				v.socket = s;
+				v.sent = 0;
+				v.hasShown = false;
+				v.version = 0;
+				v.keys = 0;
+				FrameStream::encodeHello(m_palette, v.out);
+				m_connections.push_back(std::move(v));
+			}
+		}
+
+		updateKeys();
+		m_viewers = (int)m_connections.size();
+	}
+}
+
+void StreamServer::queueFrame(Viewer& v) {
+	// One message in flight per viewer: a slow one skips frames rather than building up a backlog
+	if (v.sent < v.out.size())
+		return;
+	v.out.clear();
+	v.sent = 0;
+
+	if (m_currentVersion == 0 || v.version == m_currentVersion)
+		return;
+
+	// A mode switch changes the row size, so it starts over with a keyframe like a new viewer
+	if (!v.hasShown || v.shown.hiRes != m_current.hiRes)
+		FrameStream::encodeKeyframe(m_current, v.out);
+	else FrameStream::encodeDelta(v.shown, m_current, v.out);
+
+	v.shown = m_current;
+	v.hasShown = true;
+	v.version = m_currentVersion;
+}
+
+bool StreamServer::readViewer(Viewer& v) {
+	uint8_t buf[256];
+	long n;
+	while ((n = StreamSocket::receiveSome(v.socket, buf, sizeof(buf))) > 0)
+		v.in.insert(v.in.end(), buf, buf + n);
+	if (n < 0)
+		return false;
+
+	size_t used = 0;
+	while (true) {
+		long size = FrameStream::messageSize(v.in.data() + used, v.in.size() - used);
+		if (size < 0)
+			return false;
+		if (size == 0)
+			break;
+
+		const uint8_t* m = v.in.data() + used;
+		if (m[0] == STREAM_KEYS && size >= 7)
+			v.keys = (uint16_t)(m[5] | (m[6] << 8));
+		used += size;
+	}
+	v.in.erase(v.in.begin(), v.in.begin() + used);
+	return true;
+}
+
+bool StreamServer::writeViewer(Viewer& v) {
+	long n = StreamSocket::sendSome(v.socket, v.out.data() + v.sent, v.out.size() - v.sent);
+	if (n < 0)
+		return false;
+
+	v.sent += n;
+	m_bytesSent += n;
+	return true;
+}
+
+void StreamServer::updateKeys() {
+	uint16_t keys = 0;
+	for (const Viewer& v : m_connections)
+		keys |= v.keys;
+	m_keys.store(keys, std::memory_order_relaxed);
+}
@@ -0,0 +1,104 @@
+#ifndef STREAMSERVER_H
+#define STREAMSERVER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include "DisplayFrame.h"
+#include "FrameBus.h"
+#include "FrameStream.h"
+#include "constants.h"
+
+// Streams the display to viewers on localhost TCP or a Unix socket, and takes their key presses back
+// Each viewer gets a keyframe, then deltas of only the rows that changed (see FrameStream)
+// All socket work happens on a thread of its own; a viewer that can't keep up isn't waited for, it
+// just gets its next delta against whatever it was last sent once its previous one is out
+// Frames come from a FrameBus; the server only ever wants the newest, so FRAME_DROP_OLDEST with a depth of 1 suits it
+class StreamServer : public FrameSink {
+public:
+	StreamServer();
+
+	// Disconnects everyone
+	~StreamServer();
+
+	// Listen on address, see StreamSocket for the forms it takes; palette goes to viewers for coloring
+	bool start(const std::string& address, const uint32_t palette[1 << XO_NUM_PLANES]);
+	void stop();
+
+	bool isRunning() const { return m_running; }
+
+	// Take a frame from the bus; only a changed one is handed over to the server thread
+	void consumeFrame(const DisplayFrame& frame, uint64_t number);
+
+	// Keys held by any viewer, bit n for key n
+	uint16_t getKeys() const { return m_keys.load(std::memory_order_relaxed); }
+
+	// Viewers connected now, and bytes sent to all of them so far
+	int getViewers() const { return m_viewers; }
+	uint64_t getBytesSent() const { return m_bytesSent; }
+
+private:
+	struct Viewer {
+		socket_t socket;
+
+		// Bytes waiting to go out, sent of them already have
+		std::vector<uint8_t> out;
+		size_t sent;
+
+		// Partial messages received
+		std::vector<uint8_t> in;
+
+		// What the viewer has been sent, and which published frame that was
+		DisplayFrame shown;
+		bool hasShown;
+		uint32_t version;
+
+		uint16_t keys;
+	};
+
+	socket_t m_listen;
+	std::string m_address;
+	uint32_t m_palette[1 << XO_NUM_PLANES];
+
+	std::thread m_thread;
+	std::atomic<bool> m_running;
+
+	// Newest frame from consumeFrame and how many there have been, guarded by m_lock
+	DisplayFrame m_latest;
+	uint32_t m_version;
+	std::mutex m_lock;
+
+	// Only used by consumeFrame: the frame being offered, and the one last handed over
+	DisplayFrame m_offered;
+	DisplayFrame m_published;
+	bool m_hasPublished;
+
+	// Only used on the server thread
+	std::vector<Viewer> m_connections;
+	DisplayFrame m_current;
+	uint32_t m_currentVersion;
+
+	std::atomic<uint16_t> m_keys;
+	std::atomic<int> m_viewers;
+	std::atomic<uint64_t> m_bytesSent;
+
+	// Server thread: accept, read keys, queue and send frames until stopped
+	void run();
+
+	// Queue the next frame for v if it's ready for one
+	void queueFrame(Viewer& v);
+
+	// Take whatever v sent; returns false if it hung up or sent nonsense
+	bool readViewer(Viewer& v);
+
+	// Send what v has waiting; returns false if it hung up
+	bool writeViewer(Viewer& v);
+
+	// Combine every viewer's keys into m_keys
+	void updateKeys();
+};
+
+#endif
@@ -0,0 +1,195 @@
+#include "TerminalRenderer.h"
+#include <cstdio>
+#include <iostream>
+#include "DisplayFrame.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#ifndef ENABLE_VIRTUAL_TERMINAL_PROCESSING
+#define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
+#endif
+#endif
+
+// Cell value that matches nothing, for cells whose contents the terminal doesn't know yet
+static const uint16_t CELL_UNKNOWN = 0xFFFF;
+
+// Braille dot bit for each pixel of a 2x4 cell, [row][column], as laid out in U+2800-U+28FF
+static const uint8_t BRAILLE_DOTS[4][2] = {
+	{ 0x01, 0x08 },
+	{ 0x02, 0x10 },
+	{ 0x04, 0x20 },
+	{ 0x40, 0x80 }
+};
+
+TerminalRenderer::TerminalRenderer() {
+	m_frames = 0;
+	m_bytes = 0;
+	m_columns = 0;
+	m_rows = 0;
+	m_cursorX = -1;
+	m_cursorY = -1;
+	m_foreground = -1;
+	m_background = -1;
+	setPalette(CH8_PALETTE);
+	setStyle(TERM_NONE);
+}
+
+void TerminalRenderer::setStyle(int style) {
+	m_style = style >= 0 && style < TERM_STYLE_COUNT ? style : TERM_NONE;
+	m_cellWidth = m_style == TERM_BRAILLE ? 2 : 1;
+	m_cellHeight = m_style == TERM_BRAILLE ? 4 : 2;
+
+	// Forces a clear and a full redraw in the new style
+	m_columns = 0;
+	m_rows = 0;
+}
+
+void TerminalRenderer::setPalette(const uint32_t palette[1 << XO_NUM_PLANES]) {
+	for (int i = 0; i < (1 << XO_NUM_PLANES); i++)
+		m_palette[i] = palette[i];
+	m_columns = 0;
+	m_rows = 0;
+}
+
+const char* TerminalRenderer::styleName(int style) {
+	switch (style) {
+	case TERM_HALF_BLOCK: return "half blocks";
+	case TERM_BRAILLE: return "braille";
+	default: return "none";
+	}
+}
+
+void TerminalRenderer::begin() {
+#ifdef _WIN32
+	// Windows consoles only take escapes and UTF-8 when asked to
+	HANDLE console = GetStdHandle(STD_OUTPUT_HANDLE);
+	DWORD mode = 0;
+	if (GetConsoleMode(console, &mode))
+		SetConsoleMode(console, mode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+	SetConsoleOutputCP(CP_UTF8);
+#endif
+
+	m_frames = 0;
+	m_bytes = 0;
+	m_columns = 0;
+	m_rows = 0;
+
+	// Hide the cursor; the first draw clears the screen
+	std::cout << "\x1b[?25l";
+	std::cout.flush();
+}
+
+void TerminalRenderer::end() {
+	char buf[32];
+	snprintf(buf, sizeof(buf), "\x1b[0m\x1b[%d;1H\x1b[?25h", m_rows + 1);
+	std::cout << buf;
+	std::cout.flush();
+}
+
+int TerminalRenderer::pixel(const DisplayFrame& f, int x, int y) const {
+	if (f.megaMode)
+		return DisplayFrame::isLit(DisplayFrame::megaSample(f.megaSampleRow(y), x)) ? 1 : 0;
+
+	int shift = 63 - (x & 63);
+	return ((f.getRow(0, y)[x >> 6] >> shift) & 1) | (((f.getRow(1, y)[x >> 6] >> shift) & 1) << 1);
+}
+
+uint16_t TerminalRenderer::cell(const DisplayFrame& f, int cx, int cy) const {
+	if (m_style == TERM_HALF_BLOCK)
+		return (uint16_t)((pixel(f, cx, cy * 2) << 2) | pixel(f, cx, cy * 2 + 1));
+
+	uint16_t dots = 0;
+	for (int r = 0; r < 4; r++)
+		for (int c = 0; c < 2; c++)
+			if (pixel(f, cx * 2 + c, cy * 4 + r))
+				dots |= BRAILLE_DOTS[r][c];
+	return dots;
+}
+
+void TerminalRenderer::setColor(int which, int index) {
+	int& current = which == 38 ? m_foreground : m_background;
+	if (current == index)
+		return;
+	current = index;
+
+	uint32_t c = m_palette[index];
+	char buf[32];
+	snprintf(buf, sizeof(buf), "\x1b[%d;2;%u;%u;%um", which, (c >> 16) & 0xFF, (c >> 8) & 0xFF, c & 0xFF);
+	m_out += buf;
+}
+
+void TerminalRenderer::writeCell(int cx, int cy, uint16_t value) {
+	// Writing a cell moves the cursor one to the right, so runs of changed cells need no moves
+	if (cx != m_cursorX || cy != m_cursorY) {
+		char buf[32];
+		snprintf(buf, sizeof(buf), "\x1b[%d;%dH", cy + 1, cx + 1);
+		m_out += buf;
+	}
+
+	if (m_style == TERM_HALF_BLOCK) {
+		// Upper half block: top pixel in the foreground color, bottom pixel in the background color
+		setColor(38, value >> 2);
+		setColor(48, value & 3);
+		m_out += "\xE2\x96\x80";
+	}
+	else {
+		setColor(38, 1);
+		setColor(48, 0);
+		m_out += (char)0xE2;
+		m_out += (char)(0xA0 | (value >> 6));
+		m_out += (char)(0x80 | (value & 0x3F));
+	}
+
+	m_cursorX = cx + 1;
+	m_cursorY = cy;
+}
+
+void TerminalRenderer::draw(const DisplayFrame& f) {
+	if (m_style == TERM_NONE)
+		return;
+
+	const int width = f.megaMode ? SCHIP_WIDTH : f.getWidth();
+	const int height = f.megaMode ? SCHIP_HEIGHT : f.getHeight();
+	const int columns = width / m_cellWidth;
+	const int rows = height / m_cellHeight;
+	uint64_t dirty = f.dirty;
+
+	// New size or style: wipe the old picture and draw every cell
+	if (columns != m_columns || rows != m_rows) {
+		m_columns = columns;
+		m_rows = rows;
+		m_cells.assign(columns * rows, CELL_UNKNOWN);
+		m_out += "\x1b[0m\x1b[2J";
+		m_foreground = -1;
+		m_background = -1;
+		m_cursorX = -1;
+		dirty = ~0ULL;
+	}
+
+	// MegaChip frames are whole frames, not rows
+	if (f.megaMode && dirty)
+		dirty = ~0ULL;
+
+	const uint64_t cellRows = (1ULL << m_cellHeight) - 1;
+	for (int cy = 0; cy < rows; cy++) {
+		if (!(dirty & (cellRows << (cy * m_cellHeight))))
+			continue;
+		for (int cx = 0; cx < columns; cx++) {
+			uint16_t value = cell(f, cx, cy);
+			uint16_t& shown = m_cells[cy * columns + cx];
+			if (value == shown)
+				continue;
+			shown = value;
+			writeCell(cx, cy, value);
+		}
+	}
+
+	if (m_out.empty())
+		return;
+
+	std::cout.write(m_out.data(), m_out.size());
+	std::cout.flush();
+	m_bytes += m_out.size();
+	m_out.clear();
+	++m_frames;
+}
@@ -0,0 +1,85 @@
+#ifndef TERMINALRENDERER_H
+#define TERMINALRENDERER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "constants.h"
+
+struct DisplayFrame;
+
+// How display pixels map to terminal character cells
+enum TerminalStyle {
+	TERM_NONE = 0,          // Draw in a window as usual
+	TERM_HALF_BLOCK = 1,    // One column by two rows per cell, in full XO-CHIP color
+	TERM_BRAILLE = 2,       // Two columns by four rows per cell, lit or unlit only
+	TERM_STYLE_COUNT = 3
+};
+
+// Draws the display in a terminal with ANSI escapes, for machines only reachable over SSH
+// Keeps what every cell shows, so each frame only sends the cells that changed
+class TerminalRenderer {
+public:
+	TerminalRenderer();
+
+	// Pick the cell style, TerminalStyle values
+	void setStyle(int style);
+	int getStyle() const { return m_style; }
+	bool isEnabled() const { return m_style != TERM_NONE; }
+
+	// Colors for each combination of plane bits, 0xAARRGGBB
+	void setPalette(const uint32_t palette[1 << XO_NUM_PLANES]);
+
+	// Take over the terminal: hide the cursor and clear it
+	void begin();
+
+	// Give it back the way it was, cursor below the picture
+	void end();
+
+	// Send the cells of f's dirty rows that differ from what the terminal shows
+	void draw(const DisplayFrame& f);
+
+	// Frames drawn and bytes sent since begin
+	unsigned long getFrames() const { return m_frames; }
+	unsigned long long getBytesWritten() const { return m_bytes; }
+
+	// Name of a style for messages
+	static const char* styleName(int style);
+
+private:
+	int m_style;
+
+	// Display pixels per cell for the current style
+	int m_cellWidth, m_cellHeight;
+
+	uint32_t m_palette[1 << XO_NUM_PLANES];
+
+	// What every cell shows: top and bottom color index for half blocks, the dot pattern for braille
+	// Sized for the current display, CELL_UNKNOWN where the terminal's contents aren't known
+	std::vector<uint16_t> m_cells;
+	int m_columns, m_rows;
+
+	// Escapes for a frame are built here and written in one go
+	std::string m_out;
+
+	// Where the terminal's cursor is and which colors are set, -1 if unknown
+	int m_cursorX, m_cursorY;
+	int m_foreground, m_background;
+
+	unsigned long m_frames;
+	unsigned long long m_bytes;
+
+	// Color index of a display pixel; MegaChip frames are sampled down to 128x64 and shown lit or unlit
+	int pixel(const DisplayFrame& f, int x, int y) const;
+
+	// Work out what cell (cx, cy) should show
+	uint16_t cell(const DisplayFrame& f, int cx, int cy) const;
+
+	// Append the escapes that draw value at cell (cx, cy)
+	void writeCell(int cx, int cy, uint16_t value);
+
+	// Append a 24-bit color escape, 38 for foreground or 48 for background, if it isn't set already
+	void setColor(int which, int index);
+};
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Hands the latest of a stream of values from one writer thread to one reader thread without locks
+// The writer fills its own slot and swaps it with the middle one; the reader swaps its slot with the middle
+// when a fresh one is there. Neither side ever waits, and values the reader was too slow for are skipped.
+template <typename T>
+class TripleBuffer {
+public:
+	TripleBuffer() : m_slots(new T[3]()), m_write(0), m_read(1), m_middle(2) {}
+
+	// Writer: the slot to fill in, which the reader never sees until publish
+	T& writeSlot() { return m_slots[m_write]; }
+
+	// Writer: make the filled slot the latest and take the old middle slot to write next
+	void publish() {
+		m_write = m_middle.exchange(m_write | FRESH, std::memory_order_acq_rel) & INDEX;
+	}
+
+	// Reader: switch to the latest published slot, returns false if nothing was published since last time
+	bool consume() {
+		if (!(m_middle.load(std::memory_order_relaxed) & FRESH))
+			return false;
+		m_read = m_middle.exchange(m_read, std::memory_order_acq_rel) & INDEX;
+		return true;
+	}
+
+	// Reader: the slot from the last successful consume
+	const T& readSlot() const { return m_slots[m_read]; }
+
+private:
+	// The middle index carries a flag for whether the writer has put something new there
+	static const uint8_t INDEX = 0x3;
+	static const uint8_t FRESH = 0x4;
+
+	// On the heap, frames are too big for the stack Emulator usually lives on
+	std::unique_ptr<T[]> m_slots;
+
+	uint8_t m_write;
+	uint8_t m_read;
+	std::atomic<uint8_t> m_middle;
+};
+
+#endif
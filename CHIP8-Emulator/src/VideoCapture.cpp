@@ -0,0 +1,235 @@
+#include "VideoCapture.h"
+#include <iostream>
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <csignal>
+#endif
+
+VideoCapture::VideoCapture() {
+	m_file = NULL;
+	m_timecodes = NULL;
+	m_scale = 1;
+	m_haveLast = false;
+	m_lastNumber = 0;
+	m_frames = 0;
+	m_repeats = 0;
+	m_dropped = 0;
+	m_bytes = 0;
+	m_written = 0;
+	m_failed = false;
+}
+
+VideoCapture::~VideoCapture() {
+	close();
+}
+
+bool VideoCapture::open(const std::string& path, int scale, const uint32_t palette[1 << XO_NUM_PLANES], const std::string& timecodePath) {
+	close();
+
+	if (path == "-") {
+#ifdef _WIN32
+		// Otherwise every 0x0A in the picture gets a 0x0D put in front of it
+		_setmode(_fileno(stdout), _O_BINARY);
+#else
+		// An encoder that quits early should end the capture, not the emulator
+		signal(SIGPIPE, SIG_IGN);
+#endif
+		m_file = stdout;
+	}
+	else m_file = fopen(path.c_str(), "wb");
+
+	if (m_file == NULL) {
+		std::cerr << "Could not open " << path << " for capture" << std::endl;
+		return false;
+	}
+
+	if (!timecodePath.empty()) {
+		m_timecodes = fopen(timecodePath.c_str(), "w");
+		if (m_timecodes == NULL) {
+			std::cerr << "Could not open " << timecodePath << " for timecodes" << std::endl;
+			if (m_file != stdout)
+				fclose(m_file);
+			m_file = NULL;
+			return false;
+		}
+		fputs("# timestamp format v2\n", m_timecodes);
+	}
+
+	m_scale = std::min(std::max(scale, 1), CAPTURE_MAX_SCALE);
+	m_expander.setPalette(palette);
+
+	// Everything the writer needs is allocated here, not while the game runs
+	const size_t pixels = (size_t)SCHIP_WIDTH * SCHIP_HEIGHT * m_scale * m_scale;
+	m_canvas.resize(SCHIP_WIDTH * SCHIP_HEIGHT);
+	m_record.assign(6 + pixels * 3, 0);
+	memcpy(m_record.data(), "FRAME\n", 6);
+
+	m_haveLast = false;
+	m_lastNumber = 0;
+	m_frames = 0;
+	m_repeats = 0;
+	m_dropped = 0;
+	m_bytes = 0;
+	m_written = 0;
+	m_failed = false;
+
+	// Full-range colors would be closer to the palette, but most players assume limited range
+	char header[96];
+	int n = snprintf(header, sizeof(header), "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C444 XCOLORRANGE=LIMITED\n",
+		SCHIP_WIDTH * m_scale, SCHIP_HEIGHT * m_scale, (int)TARGET_FRAMERATE);
+	output(header, n);
+	return !m_failed;
+}
+
+void VideoCapture::close() {
+	if (m_file == NULL)
+		return;
+
+	if (m_file == stdout)
+		fflush(m_file);
+	else fclose(m_file);
+	m_file = NULL;
+
+	if (m_timecodes != NULL)
+		fclose(m_timecodes);
+	m_timecodes = NULL;
+}
+
+void VideoCapture::copyFrame(DisplayFrame& dst, const DisplayFrame& src) {
+	// Only the half that's in use, the MegaChip one is much the bigger
+	dst.hiRes = src.hiRes;
+	dst.megaMode = src.megaMode;
+	if (src.megaMode)
+		dst.mega = src.mega;
+	else memcpy(dst.gfx, src.gfx, sizeof(dst.gfx));
+}
+
+bool VideoCapture::sameFrame(const DisplayFrame& a, const DisplayFrame& b) {
+	if (a.megaMode != b.megaMode || a.hiRes != b.hiRes)
+		return false;
+	if (a.megaMode)
+		return a.mega == b.mega;
+
+	const size_t words = (size_t)a.getRowWords() * a.getHeight();
+	for (int p = 0; p < XO_NUM_PLANES; p++)
+		if (memcmp(a.gfx[p], b.gfx[p], words * sizeof(uint64_t)) != 0)
+			return false;
+	return true;
+}
+
+void VideoCapture::consumeFrame(const DisplayFrame& frame, uint64_t number) {
+	if (m_file == NULL)
+		return;
+
+	// Whatever the bus dropped in between comes out as the last frame again; before the first frame
+	// there's nothing to repeat, so those simply go missing
+	const unsigned long missed = m_haveLast ? (unsigned long)(number - m_lastNumber - 1) : 0;
+	m_lastNumber = number;
+	m_frames += missed + 1;
+	m_dropped += missed;
+
+	if (m_haveLast && sameFrame(frame, m_last)) {
+		++m_repeats;
+		repeat(missed + 1);
+		return;
+	}
+	repeat(missed);
+
+	copyFrame(m_last, frame);
+	m_haveLast = true;
+
+	if (m_failed)
+		return;
+	encode(frame);
+	output(m_record.data(), m_record.size());
+	if (m_failed)
+		return;
+	if (m_timecodes != NULL)
+		fprintf(m_timecodes, "%.3f\n", m_written * 1000.0 / TARGET_FRAMERATE);
+	++m_written;
+}
+
+void VideoCapture::repeat(unsigned long n) {
+	if (m_failed)
+		return;
+
+	// m_record still holds the last frame; with timecodes a repeat is only a gap in the times
+	if (m_timecodes == NULL)
+		for (unsigned long i = 0; i < n; i++)
+			output(m_record.data(), m_record.size());
+	if (!m_failed)
+		m_written += n;
+}
+
+void VideoCapture::encode(const DisplayFrame& e) {
+	// Lay the frame out at SCHIP_WIDTH x SCHIP_HEIGHT first, MegaChip taking every other pixel across and every third down
+	if (e.megaMode) {
+		for (int y = 0; y < SCHIP_HEIGHT; y++) {
+			const uint32_t* row = e.megaSampleRow(y);
+			for (int x = 0; x < SCHIP_WIDTH; x++)
+				m_canvas[y * SCHIP_WIDTH + x] = DisplayFrame::megaSample(row, x);
+		}
+	}
+	else if (e.hiRes) {
+		for (int y = 0; y < SCHIP_HEIGHT; y++)
+			m_expander.expandRow(&e.gfx[0][y * CH8_ROW_WORDS], &e.gfx[1][y * CH8_ROW_WORDS], SCHIP_WIDTH, &m_canvas[y * SCHIP_WIDTH]);
+	}
+	else {
+		uint32_t row[CH8_WIDTH];
+		for (int y = 0; y < CH8_HEIGHT; y++) {
+			m_expander.expandRow(&e.gfx[0][y], &e.gfx[1][y], CH8_WIDTH, row);
+			uint32_t* dst = &m_canvas[y * 2 * SCHIP_WIDTH];
+			for (int x = 0; x < CH8_WIDTH; x++)
+				dst[x * 2] = dst[x * 2 + 1] = row[x];
+			std::copy(dst, dst + SCHIP_WIDTH, dst + SCHIP_WIDTH);
+		}
+	}
+
+	// BT.601 limited range, each plane full size (4:4:4) so no pixel edge gets smeared
+	// Only a handful of colors are ever on screen, so the last conversion is kept and reused; it starts as black
+	const int width = SCHIP_WIDTH * m_scale;
+	const size_t planeSize = (size_t)width * SCHIP_HEIGHT * m_scale;
+	uint8_t* planes[3] = { &m_record[6], &m_record[6 + planeSize], &m_record[6 + planeSize * 2] };
+	uint32_t lastColor = 0;
+	uint8_t yuv[3] = { 16, 128, 128 };
+
+	for (int y = 0; y < SCHIP_HEIGHT; y++) {
+		const uint32_t* src = &m_canvas[y * SCHIP_WIDTH];
+		const size_t rowStart = (size_t)y * m_scale * width;
+
+		for (int x = 0; x < SCHIP_WIDTH; x++) {
+			uint32_t c = src[x] & 0xFFFFFF;
+			if (c != lastColor) {
+				int r = (c >> 16) & 0xFF, g = (c >> 8) & 0xFF, b = c & 0xFF;
+				yuv[0] = (uint8_t)(((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+				yuv[1] = (uint8_t)(((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+				yuv[2] = (uint8_t)(((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+				lastColor = c;
+			}
+			for (int p = 0; p < 3; p++)
+				memset(planes[p] + rowStart + x * m_scale, yuv[p], m_scale);
+		}
+
+		// Widen the row once, then copy it down for the rest of the block
+		for (int p = 0; p < 3; p++)
+			for (int r = 1; r < m_scale; r++)
+				memcpy(planes[p] + rowStart + r * width, planes[p] + rowStart, width);
+	}
+}
+
+void VideoCapture::output(const void* data, size_t n) {
+	if (m_failed)
+		return;
+
+	if (fwrite(data, 1, n, m_file) != n) {
+		std::cerr << "Capture write failed, no more frames will be written" << std::endl;
+		m_failed = true;
+		return;
+	}
+	m_bytes += n;
+}
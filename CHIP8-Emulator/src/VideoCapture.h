@@ -0,0 +1,91 @@
+#ifndef VIDEOCAPTURE_H
+#define VIDEOCAPTURE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <atomic>
+#include "DisplayFrame.h"
+#include "FrameBus.h"
+#include "PixelExpander.h"
+#include "constants.h"
+
+// Records every 60 Hz frame as an uncompressed YUV4MPEG2 (Y4M) stream, to a file or to stdout for an encoder
+// The picture is always SCHIP_WIDTH x SCHIP_HEIGHT times the scale, since Y4M can't change size midway:
+// CHIP-8 frames are pixel-doubled and MegaChip frames point-sampled, like the grid view does
+// Frames come from a FrameBus, which delivers them on a thread of its own, so a slow disk or encoder
+// drops frames instead of slowing the game; FRAME_BLOCK with CAPTURE_QUEUE_SIZE rides out short stalls
+class VideoCapture : public FrameSink {
+public:
+	VideoCapture();
+	~VideoCapture();
+
+	// Start a capture to path, "-" for stdout, each pixel scaled up by scale (1-CAPTURE_MAX_SCALE),
+	// CHIP-8 frames colored with palette
+	// Y4M has no way to mark a frame as repeated, so repeats are written out again by default; with a
+	// timecode path they're left out of the video and each frame's time goes into a Matroska v2
+	// timecode file instead, for mkvmerge --timestamps to put back together
+	bool open(const std::string& path, int scale, const uint32_t palette[1 << XO_NUM_PLANES], const std::string& timecodePath = "");
+
+	// Close the files; take the capture off the bus first so nothing is still being written
+	void close();
+
+	bool isOpen() const { return m_file != NULL; }
+
+	// Whether repeats are being left out of the video for the timecode file, rather than written again
+	bool hasTimecodes() const { return m_timecodes != NULL; }
+
+	// Write a frame from the bus; one that matches the last is a repeat, and frames the bus dropped
+	// are written as repeats of the last one, so the video keeps its length
+	void consumeFrame(const DisplayFrame& frame, uint64_t number);
+
+	// Frames received, how many of them were repeats, and how many were dropped
+	unsigned long getFrames() const { return m_frames; }
+	unsigned long getRepeats() const { return m_repeats; }
+	unsigned long getDropped() const { return m_dropped; }
+
+	// Frames in the video so far, repeats included; falls short of getFrames if a write failed
+	unsigned long getWritten() const { return m_written; }
+
+	// Bytes written to the video
+	uint64_t getBytesWritten() const { return m_bytes; }
+
+private:
+	FILE* m_file;
+	FILE* m_timecodes;
+	int m_scale;
+
+	// The last frame written and its number on the bus
+	DisplayFrame m_last;
+	bool m_haveLast;
+	uint64_t m_lastNumber;
+
+	std::atomic<unsigned long> m_frames;
+	std::atomic<unsigned long> m_repeats;
+	std::atomic<unsigned long> m_dropped;
+	std::atomic<uint64_t> m_bytes;
+	std::atomic<unsigned long> m_written;
+
+	PixelExpander m_expander;
+	std::vector<uint8_t> m_record;
+	std::vector<uint32_t> m_canvas;
+	bool m_failed;
+
+	// Copy the picture of src, only the half that's in use
+	static void copyFrame(DisplayFrame& dst, const DisplayFrame& src);
+
+	// True if a and b would look the same
+	static bool sameFrame(const DisplayFrame& a, const DisplayFrame& b);
+
+	// Write the last frame n more times
+	void repeat(unsigned long n);
+
+	// Convert a frame to a complete FRAME record in m_record
+	void encode(const DisplayFrame& f);
+
+	// Write n bytes to the video, noting a failure instead of retrying
+	void output(const void* data, size_t n);
+};
+
+#endif
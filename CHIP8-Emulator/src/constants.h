@@ -4,8 +4,12 @@
 // Constants relating to the CHIP-8 machine itself
 const int CH8_WIDTH = 64;
 const int CH8_HEIGHT = 32;
+const int SCHIP_WIDTH = 128;
+const int SCHIP_HEIGHT = 64;
+const int CH8_ROW_WORDS = SCHIP_WIDTH / 64;   // uint64_t words per display row
 const int CH8_STACK_SIZE = 24;
-const int CH8_MEM_SIZE = 0x1000;
+const int CH8_MEM_SIZE = 0x10000;        // XO-CHIP's 64 KB; plain CHIP-8 ROMs only use the first 4 KB
+const int CH8_ADDR_MASK = CH8_MEM_SIZE - 1;
 const int DEFAULT_SCALE = 10;
 const int CH8_MAX_SPRITE_WIDTH = 8;
 const int CH8_FONT_WIDTH = 5;
@@ -28,18 +32,86 @@ const uint8_t CH8_FONTSET[80] = {
   0xF0, 0x80, 0xF0, 0x80, 0x80  // F
 };
 
+// Constants relating to SUPER-CHIP
+const int SCHIP_BIG_SPRITE_SIZE = 16;
+const int SCHIP_SCROLL_X = 4;
+const int SCHIP_NUM_FLAGS = 16;          // SUPER-CHIP has 8, XO-CHIP allows all 16 registers
+const int SCHIP_BIG_FONT_WIDTH = 10;
+const int SCHIP_BIG_FONT_OFFSET = sizeof(CH8_FONTSET);
+const uint8_t SCHIP_BIG_FONTSET[100] = {
+  0x3C, 0x7E, 0xE7, 0xC3, 0xC3, 0xC3, 0xC3, 0xE7, 0x7E, 0x3C, // 0
+  0x18, 0x38, 0x58, 0x18, 0x18, 0x18, 0x18, 0x18, 0x18, 0x3C, // 1
+  0x3E, 0x7F, 0xC3, 0x06, 0x0C, 0x18, 0x30, 0x60, 0xFF, 0xFF, // 2
+  0x3C, 0x7E, 0xC3, 0x03, 0x0E, 0x0E, 0x03, 0xC3, 0x7E, 0x3C, // 3
+  0x06, 0x0E, 0x1E, 0x36, 0x66, 0xC6, 0xFF, 0xFF, 0x06, 0x06, // 4
+  0xFF, 0xFF, 0xC0, 0xC0, 0xFC, 0xFE, 0x03, 0xC3, 0x7E, 0x3C, // 5
+  0x3E, 0x7C, 0xE0, 0xC0, 0xFC, 0xFE, 0xC3, 0xC3, 0x7E, 0x3C, // 6
+  0xFF, 0xFF, 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x60, 0x60, // 7
+  0x3C, 0x7E, 0xC3, 0xC3, 0x7E, 0x7E, 0xC3, 0xC3, 0x7E, 0x3C, // 8
+  0x3C, 0x7E, 0xC3, 0xC3, 0x7F, 0x3F, 0x03, 0x03, 0x3E, 0x7C  // 9
+};
+
+// Constants relating to XO-CHIP
+const int XO_NUM_PLANES = 2;
+const int XO_AUDIO_PATTERN_SIZE = 16;    // 128 one-bit samples
+const int XO_DEFAULT_PITCH = 64;
+const double XO_AUDIO_BASE_RATE = 4000.0;
+
+// Colors for each combination of the two bitplanes, 0xAARRGGBB
+const uint32_t CH8_PALETTE[1 << XO_NUM_PLANES] = {
+  0xFF000000,   // Neither plane
+  0xFFFFFFFF,   // Plane 1 only
+  0xFFAAAAAA,   // Plane 2 only
+  0xFF555555    // Both planes
+};
+
+// Constants relating to MegaChip
+const int MEGA_WIDTH = 256;
+const int MEGA_HEIGHT = 192;
+const int MEGA_MEM_SIZE = 0x1000000;     // 24-bit I
+const int MEGA_PALETTE_SIZE = 256;
+
+// Constants relating to the CPU upscaling filters
+const int SCALE_MAX_FACTOR = 3;
+const int SCALE_ROW_WORDS = CH8_ROW_WORDS * SCALE_MAX_FACTOR;   // uint64_t words per scaled row
+
+// Phosphor persistence: most frames mixed together, and the default mix, newest first
+const int PHOSPHOR_MAX_FRAMES = 8;
+const int PHOSPHOR_DEFAULT_FRAMES = 4;
+const int PHOSPHOR_DEFAULT_WEIGHTS[PHOSPHOR_DEFAULT_FRAMES] = { 4, 3, 2, 1 };
+
+// Streaming texture size, big enough for a MegaChip frame or a 3x scaled 128x64 one
+const int TEXTURE_WIDTH = SCHIP_WIDTH * SCALE_MAX_FACTOR > MEGA_WIDTH ? SCHIP_WIDTH * SCALE_MAX_FACTOR : MEGA_WIDTH;
+const int TEXTURE_HEIGHT = SCHIP_HEIGHT * SCALE_MAX_FACTOR > MEGA_HEIGHT ? SCHIP_HEIGHT * SCALE_MAX_FACTOR : MEGA_HEIGHT;
+
 // Constants relating to clock rate and frames per second
 const double TARGET_FRAMERATE = 60.0;
 const double TARGET_FRAMETIME_MILLISECONDS = 1000.0 / TARGET_FRAMERATE;
 const double TARGET_FRAMETIME_SECONDS = 1.0 / TARGET_FRAMERATE;
 const int SDL_DELAY_VALUE = 10;
+const int CYCLES_PER_FRAME = 10;          // Instructions per 60 Hz guest frame when frames are scheduled, not drawn
+const int MAX_CATCHUP_FRAMES = 4;         // Guest frames run at most per refresh before falling behind on purpose
 const int MAX_STORED_FPS_VALS = 10;
 
+// How many times a reader retries a state snapshot that was overwritten while being copied
+const int SNAPSHOT_READ_ATTEMPTS = 4;
+
 // Error code constants
 const int SUCCESS = 0;
 const int ERR_INIT_SDL = 1;
 const int ERR_ROM_READ = -1;
 const int ERR_ROM_TOO_BIG = -2;
+const int ERR_CACHE_READ = -4;
+const int ERR_CACHE_WRITE = -5;
+const int ERR_GRID_FULL = -6;
+const int ERR_SCREENSHOT_WRITE = -7;
+const int ERR_CAPTURE_OPEN = -8;
+const int ERR_SHARED_MEMORY = -9;
+const int ERR_STREAM = -10;
+const int ERR_AUDIO_DEVICE = -11;
+const int ERR_STRESS_GROWTH = -12;
+const int ERR_BENCH_MISMATCH = -13;
+const int ERR_BENCH_LAUNCH = -14;
 
 // Sound
 const int MEGABYTE = 1048576;
@@ -49,7 +121,67 @@ const int SOUND_NUM_CHANNELS = 1;
 const int SOUND_NUM_SAMPLES = 1024;
 const int SOUND_DEFAULT_GAIN = 4000;
 const int SOUND_SAMPLE_SIZE = 2;      // sizeof(int16_t)
-const int SOUND_INITIAL_BUFFER_TIME = 10;
+const int SOUND_QUEUE_LEAD_SAMPLES = SOUND_NUM_SAMPLES * 2;   // Queued ahead while the tone is on, a device buffer to spare
 const int SOUND_DEFAULT_PLAY_FREQUENCY = 400;
 
+// Callback audio: tone changes that can wait for the callback, and the smallest device buffer asked for
+const uint32_t SOUND_EVENT_QUEUE_SIZE = 64;
+const int SOUND_MIN_DEVICE_SAMPLES = 64;
+
+// Performance HUD; the font isn't shipped, so give a TTF with --hud-font or put one at this path
+const char* const HUD_FONT_PATH = "fonts/hud.ttf";
+const int HUD_FONT_SIZE = 14;
+const int HUD_FIRST_GLYPH = 32;          // Printable ASCII goes into the atlas
+const int HUD_LAST_GLYPH = 126;
+const int HUD_ATLAS_WIDTH = 512;
+const int HUD_MARGIN = 6;
+const int HUD_UPDATE_MS = 250;           // How often the numbers are refreshed
+const int HUD_FRAME_SAMPLES = 240;       // Present intervals kept for the percentiles
+
+// Grid view: most games in one window, and the window's starting size
+const int GRID_MAX_INSTANCES = 64;
+const int GRID_WINDOW_WIDTH = 1280;
+const int GRID_WINDOW_HEIGHT = 640;
+
+// Screenshots: how many can wait for the writer thread, the width they're scaled up to, and their file names
+const int SCREENSHOT_QUEUE_SIZE = 16;
+const int SCREENSHOT_WIDTH = CH8_WIDTH * DEFAULT_SCALE;
+const char* const SCREENSHOT_PREFIX = "screenshot_";
+
+// Frame bus: frames that can wait for the thread feeding FRAME_BLOCK sinks while one of them is full
+const int FRAME_BUS_DISPATCH_DEPTH = 8;
+
+// ROM switch stress test: switches made before memory is measured, so buffers that only grow once are
+// in the baseline, and how much it may grow after that before the test fails
+const int STRESS_SWAP_WARMUP = 100;
+const int STRESS_SWAP_MAX_GROWTH_KB = 1024;
+
+// DXYN benchmark: sprite height, how many rounds the median is taken over, and sprites per round by default
+const int BENCH_SPRITE_ROWS = 15;
+const int BENCH_SPRITE_ROUNDS = 5;
+const long BENCH_SPRITE_ITERATIONS = 1000000;
+
+// Audio benchmark: frames queued each way by default, ten seconds' worth
+const int BENCH_AUDIO_FRAMES = 600;
+
+// Video capture: frames that can wait for the writer thread (two seconds), and the largest scale factor
+const int CAPTURE_QUEUE_SIZE = 120;
+const int CAPTURE_MAX_SCALE = 8;
+
+// Shared memory frame export: what readers check before trusting the layout
+const uint32_t SHARED_FRAME_MAGIC = 0x42463843;    // "C8FB" in memory on little-endian machines
+const uint32_t SHARED_FRAME_VERSION = 1;
+const int SHARED_FRAME_READ_ATTEMPTS = 64;        // Readers spin this long past a writer before giving up
+
+// Frame streaming: protocol version, most viewers at once, largest message either side will take,
+// and how long the server thread waits on its sockets before looking for a new frame
+const int STREAM_VERSION = 1;
+const int STREAM_MAX_CLIENTS = 16;
+const int STREAM_MAX_MESSAGE = 16384;
+const int STREAM_POLL_MS = 4;
+
+// Static ROM analysis
+const char* const CFG_CACHE_DIR = "cfg_cache";
+const int CFG_CACHE_VERSION = 2;
+
 #endif
\ No newline at end of file
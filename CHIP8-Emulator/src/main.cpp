@@ -1,14 +1,216 @@
 #include <iostream>
 #include <ctime>
+#include <chrono>
+#include <string>
+#include <vector>
 #include "Chip8.h"
 #include "Emulator.h"
+#include "GridView.h"
+#include "Benchmark.h"
+#include "RomAnalyzer.h"
+#include "StreamClient.h"
+
+// Print the control-flow graph of a ROM without starting the emulator
+int analyzeRom(const std::string& path) {
+	std::vector<char> file;
+	int result = Chip8::readRom(path, file, true);
+	if (result != SUCCESS)
+		return result;
+
+	// The analyzer's memory and reachability maps cover XO-CHIP's 64 KB, so a bigger MegaChip ROM can't be
+	if (file.size() > CH8_MEM_SIZE - 0x200) {
+		std::cerr << "File too large to analyze!" << std::endl;
+		return ERR_ROM_TOO_BIG;
+	}
+	std::vector<uint8_t> rom(file.begin(), file.end());
+
+	RomAnalyzer analyzer;
+	if (analyzer.analyzeCached(rom))
+		std::cout << "Loaded analysis from cache\n";
+
+	analyzer.printReport(std::cout);
+	return SUCCESS;
+}
+
+// Run several ROMs at once in one window
+int runGrid(int count, char* paths[]) {
+	GridView grid;
+	for (int i = 0; i < count; i++)
+		grid.addRom(paths[i]);
+
+	return grid.run();
+}
 
 int main(int argc, char *argv[]) {
 
+	// chip8 --analyze <rom>
+	if (argc == 3 && std::string(argv[1]) == "--analyze")
+		return analyzeRom(argv[2]);
+
+	// chip8 --grid <rom> [<rom> ...], up to GRID_MAX_INSTANCES of them
+	if (argc >= 3 && std::string(argv[1]) == "--grid") {
+		srand(time(0));
+		return runGrid(argc - 2, argv + 2);
+	}
+
+	// chip8 --stress-swap <count> <rom> [<rom> ...]: switch between the ROMs count times, checking memory
+	if (argc >= 4 && std::string(argv[1]) == "--stress-swap") {
+		Emulator emu(ENABLE_OFFSCREEN);
+		return emu.stressSwap(std::vector<std::string>(argv + 3, argv + argc), atoi(argv[2]));
+	}
+
+	// chip8 --bench-dxyn [<sprites>]: time DXYN against the byte-per-pixel drawing it replaced
+	if (argc >= 2 && std::string(argv[1]) == "--bench-dxyn")
+		return benchSprites(argc >= 3 ? atol(argv[2]) : BENCH_SPRITE_ITERATIONS);
+
+	// chip8 --bench-audio [<frames>]: time queueing a frame of audio a sample at a time and as a block
+	if (argc >= 2 && std::string(argv[1]) == "--bench-audio") {
+		Emulator emu(0);
+		return emu.benchAudio(argc >= 3 ? atoi(argv[2]) : BENCH_AUDIO_FRAMES);
+	}
+
+	// chip8 --bench-startup <runs> <rom>: start a fresh emulator on rom runs times, timing each to its first frame
+	if (argc >= 4 && std::string(argv[1]) == "--bench-startup")
+		return benchStartup(argv[0], argv[3], atoi(argv[2]));
+
+	// chip8 [--vsync] [--blend] [--threaded] [--filter scale2x|scale3x|epx] [--phosphor] [--hud [--hud-font <file.ttf>]]
+	//       [--terminal halfblock|braille] [--offscreen <frames> [--screenshot <file.bmp>]]
+	//       [--capture <file.y4m>|- [--capture-scale <n>] [--timecodes <file.txt>]] [--shm <name>]
+	//       [--serve <port>|unix:<path>] [--audio-latency <ms>] [rom]
+	// chip8 --spectate <[host:]port>|unix:<path> [--terminal halfblock|braille]
+	// No font comes with the emulator, so --hud needs --hud-font, or a TTF at fonts/hud.ttf under the working directory
+	// --capture writes repeated frames out again, as Y4M has no way to skip one; they're only left out of
+	// the video when --timecodes gives their times somewhere to go
+	uint16_t flags = 0;
+	int filter = SCALE_NONE;
+	int terminal = TERM_NONE;
+	std::string romPath;
+	int offscreenFrames = -1;
+	std::string screenshotPath;
+	std::string capturePath;
+	std::string timecodePath;
+	int captureScale = 1;
+	std::string sharedName;
+	std::string serveAddress;
+	std::string spectateAddress;
+	double audioLatency = 0;
+	long long launchTime = -1;
+	bool phosphor = false;
+	bool hud = false;
+	std::string hudFont;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--filter" && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name == "scale2x")
+				filter = SCALE_2X;
+			else if (name == "scale3x")
+				filter = SCALE_3X;
+			else if (name == "epx")
+				filter = SCALE_EPX;
+			else std::cerr << "Unknown filter " << name << ", using none" << std::endl;
+		}
+		else if (arg == "--terminal" && i + 1 < argc) {
+			std::string name = argv[++i];
+			if (name == "halfblock")
+				terminal = TERM_HALF_BLOCK;
+			else if (name == "braille")
+				terminal = TERM_BRAILLE;
+			else std::cerr << "Unknown terminal style " << name << ", using half blocks" << std::endl;
+			if (terminal == TERM_NONE)
+				terminal = TERM_HALF_BLOCK;
+		}
+		else if (arg == "--offscreen" && i + 1 < argc) {
+			offscreenFrames = atoi(argv[++i]);
+			flags |= ENABLE_OFFSCREEN;
+		}
+		else if (arg == "--screenshot" && i + 1 < argc)
+			screenshotPath = argv[++i];
+		else if (arg == "--capture" && i + 1 < argc)
+			capturePath = argv[++i];
+		else if (arg == "--capture-scale" && i + 1 < argc)
+			captureScale = atoi(argv[++i]);
+		else if (arg == "--timecodes" && i + 1 < argc)
+			timecodePath = argv[++i];
+		else if (arg == "--shm" && i + 1 < argc)
+			sharedName = argv[++i];
+		else if (arg == "--serve" && i + 1 < argc)
+			serveAddress = argv[++i];
+		else if (arg == "--spectate" && i + 1 < argc)
+			spectateAddress = argv[++i];
+		else if (arg == "--audio-latency" && i + 1 < argc)
+			audioLatency = atof(argv[++i]);
+		else if (arg == "--startup-probe" && i + 1 < argc)
+			launchTime = atoll(argv[++i]);
+		else if (arg == "--phosphor")
+			phosphor = true;
+		else if (arg == "--hud-font" && i + 1 < argc)
+			hudFont = argv[++i];
+		else if (arg == "--hud")
+			hud = true;
+		else if (arg == "--vsync")
+			flags |= ENABLE_VSYNC;
+		else if (arg == "--blend")
+			flags |= ENABLE_FRAME_BLEND;
+		else if (arg == "--threaded")
+			flags |= ENABLE_EMU_THREAD;
+		else if (arg.compare(0, 2, "--") != 0)
+			romPath = arg;
+	}
+
 	// Seed random number generator
 	srand(time(0));
 
-	Emulator emu;
+	// No window in the terminal, so don't insist on a display; an SDL_VIDEODRIVER already set still wins
+	if (terminal != TERM_NONE)
+		SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+
+	// Watch a game another emulator is streaming instead of running one
+	if (!spectateAddress.empty()) {
+		StreamClient viewer;
+		return viewer.run(spectateAddress, terminal);
+	}
+
+	// The video owns stdout, so messages go to stderr instead
+	if (capturePath == "-")
+		std::cout.rdbuf(std::cerr.rdbuf());
+
+	Emulator emu(flags);
+	emu.setTerminalStyle(terminal);
+	emu.setScaleFilter(filter);
+	if (phosphor)
+		emu.setPhosphor(PHOSPHOR_DEFAULT_WEIGHTS, PHOSPHOR_DEFAULT_FRAMES);
+	if (!hudFont.empty())
+		emu.setHudFont(hudFont);
+	if (hud)
+		emu.toggleHud();
+	if (launchTime >= 0)
+		emu.probeStartup(std::chrono::steady_clock::time_point(
+			std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::nanoseconds(launchTime))));
+	if (!capturePath.empty() && emu.startCapture(capturePath, captureScale, timecodePath) != SUCCESS)
+		return ERR_CAPTURE_OPEN;
+	if (!sharedName.empty() && emu.startSharedExport(sharedName) != SUCCESS)
+		return ERR_SHARED_MEMORY;
+	if (!serveAddress.empty() && emu.startStreamServer(serveAddress) != SUCCESS)
+		return ERR_STREAM;
+	if (audioLatency > 0 && emu.useCallbackAudio(audioLatency) != SUCCESS)
+		return ERR_AUDIO_DEVICE;
+
+	// Run without a display and optionally save the last frame
+	if (offscreenFrames >= 0) {
+		if (romPath.empty()) {
+			std::cerr << "--offscreen needs a ROM path" << std::endl;
+			return ERR_ROM_READ;
+		}
+		int result = emu.runHeadless(romPath, offscreenFrames);
+		if (result == SUCCESS && !screenshotPath.empty())
+			result = emu.saveScreenshot(screenshotPath);
+		return result;
+	}
+
+	// A ROM on the command line skips the file dialog, which a terminal session couldn't show anyway
+	if (!romPath.empty())
+		return emu.runGame(romPath);
 
 	if (emu.selectGame()) {
 		switch (emu.runGame()) {
@@ -19,6 +221,6 @@ int main(int argc, char *argv[]) {
 	}
 
 	// Cleanup
-	
+
 	return 0;
 }